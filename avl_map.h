@@ -0,0 +1,121 @@
+/*
+AVL Map
+Ordered key→value association on top of the Set engine (avl_tree.h).
+
+Rather than duplicating the tree machinery, Map stores Entry records in a
+Set under a transparent comparator that orders by key alone, so every
+lookup descends comparing bare keys — no dummy mapped value is ever
+materialized. The mapped part of an entry is mutable: the tree's ordering
+only depends on the key, so values can be assigned in place through the
+iterators the underlying Set hands out.
+*/
+
+#ifndef AVL_MAP_H
+#define AVL_MAP_H
+
+#include <functional>
+#include <utility>
+
+#include "avl_tree.h"
+
+template<class Key, class Value, class Compare = std::less<Key>>
+class Map {
+public:
+    struct Entry {
+        Key key;
+        // The key is frozen by the Set, the mapped value stays writable
+        mutable Value value;
+
+        template<typename K2, typename V2>
+        Entry(K2&& k, V2&& v): key(std::forward<K2>(k)), value(std::forward<V2>(v)) {}
+    };
+
+private:
+    // Transparent on purpose: bare keys descend the tree directly
+    struct EntryCompare {
+        using is_transparent = void;
+
+        Compare cmp;
+
+        bool operator () (const Entry& a, const Entry& b) const {
+            return cmp(a.key, b.key);
+        }
+        bool operator () (const Entry& a, const Key& b) const {
+            return cmp(a.key, b);
+        }
+        bool operator () (const Key& a, const Entry& b) const {
+            return cmp(a, b.key);
+        }
+    };
+
+    using Entries = Set<Entry, EntryCompare>;
+
+public:
+    using iterator = typename Entries::iterator;
+
+    Map() {}
+
+    size_t size() const {
+        return entries.size();
+    }
+    bool empty() const {
+        return entries.empty();
+    }
+
+    iterator begin() const {
+        return entries.begin();
+    }
+    iterator end() const {
+        return entries.end();
+    }
+
+    iterator find(const Key& key) const {
+        return entries.find(key);
+    }
+    iterator lower_bound(const Key& key) const {
+        return entries.lower_bound(key);
+    }
+    bool contains(const Key& key) const {
+        return entries.find(key) != entries.end();
+    }
+
+    void erase(const Key& key) {
+        entries.erase(key);
+    }
+
+    // Inserts a default-constructed value on first touch; the find keeps the
+    // common repeated-key case at one descent and zero Entry constructions
+    Value& operator [] (const Key& key) {
+        iterator it = entries.find(key);
+        if (it == entries.end()) {
+            it = entries.emplace(key, Value());
+        }
+        return it->value;
+    }
+
+    template<typename V2>
+    void insert_or_assign(const Key& key, V2&& value) {
+        iterator it = entries.find(key);
+        if (it == entries.end()) {
+            entries.emplace(key, std::forward<V2>(value));
+        } else {
+            it->value = std::forward<V2>(value);
+        }
+    }
+
+    // Builds the entry in place; an existing key wins and the fresh entry is
+    // discarded, mirroring Set::emplace
+    template<typename... Args>
+    iterator emplace(Args&&... args) {
+        return entries.emplace(std::forward<Args>(args)...);
+    }
+
+    void swap(Map& other) {
+        entries.swap(other.entries);
+    }
+
+private:
+    Entries entries;
+};
+
+#endif  // AVL_MAP_H
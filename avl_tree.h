@@ -1,269 +1,1979 @@
-/*
-AVL Tree
-Main source: https://habr.com/ru/post/150732/
-Changes:
-1) Added std::list which allows to iterate through the tree
-2) Other minor upgrades added in order to pass the task
-*/
-
-#include <iterator>
-#include <list>
-
-template<class ValueType>
-class Set {
-public:
-    using init_list = std::initializer_list<ValueType>;
-    using iterator = typename std::list<ValueType>::const_iterator;
-
-    Set(): root(nullptr), sz(0), items() {}
-
-    template<typename Iterator>
-    Set(Iterator first, Iterator last): Set() {
-        for (; first != last; ++first) {
-            insert(*first);
-        }
-    }
-
-    Set(const init_list& elems): Set() {
-        for (const auto& elem : elems) {
-            insert(elem);
-        }
-    }
-
-    Set(const Set& other): Set() {
-        if (this != &other) {
-            for (auto& elem : other.items) {
-                insert(elem);
-            }
-        }
-    }
-    Set& operator = (const Set& other) {
-        if (this != &other) {
-            clear(root);
-            root = nullptr;
-            sz = 0;
-            items.clear();
-
-            for (auto& elem : other.items) {
-                insert(elem);
-            }
-        }
-
-        return *this;
-    }
-
-    ~Set() {
-        clear(root);
-        root = nullptr;
-        sz = 0;
-        items.clear();
-    }
-
-    size_t size() const {
-        return sz;
-    }
-    bool empty() const {
-        return (sz == 0);
-    }
-
-    void insert(const ValueType &elem) {
-        if (find(elem) == end()) {
-            root = put(root, elem);
-            sz++;
-        }
-    }
-    void erase(const ValueType &elem) {
-        if (find(elem) != end()) {
-            root = del(root, elem);
-            sz--;
-        }
-
-    }
-
-    iterator begin() const {
-        return items.cbegin();
-    }
-    iterator end() const {
-        return items.cend();
-    }
-
-    iterator find(const ValueType& elem) const {
-        return search(root, elem);
-    }
-    iterator lower_bound(const ValueType& elem) const {
-        return lb(root, elem);
-    }
-
-private:
-    struct Node {
-        const ValueType val;
-        int h;
-        Node* left, *right;
-        iterator iter;
-
-        Node(const ValueType& v, iterator& it): val(v), h(1), left(nullptr), right(nullptr), iter(it) {}
-    };
-
-    Node* root;
-    size_t sz;
-    std::list<ValueType> items;
-
-    void clear(Node* node) {
-        if (!node) {
-            return;
-        }
-
-        clear(node->left);
-        clear(node->right);
-        delete node;
-    }
-
-    int height(Node* node) {
-        return (node ? node->h : 0);
-    }
-    int diff(Node* node) {
-        return (node ? height(node->right) - height(node->left) : 0);
-    }
-    void relax(Node* node) {
-        node->h = 1 + std::max(height(node->left), height(node->right));
-    }
-
-    // Left rotation
-    Node* rotate_left(Node* node) {
-        Node* center = node->right;
-        node->right = center->left;
-        center->left = node;
-        relax(node);
-        relax(center);
-        return center;
-    }
-    // Right rotation
-    Node* rotate_right(Node *node) {
-        Node* center = node->left;
-        node->left = center->right;
-        center->right = node;
-        relax(node);
-        relax(center);
-        return center;
-    }
-
-    // Main AVL function: fix tree's balance
-    Node* balance(Node* node) {
-        relax(node);
-        int node_balance = diff(node);
-        // Right subtree's depth is too big
-        if (node_balance == 2) {
-            if (diff(node->right) < 0) {
-                // Right-left rotation: make right-right subtree's depth bigger than right-left subtree's
-                node->right = rotate_right(node->right);
-            }
-            // Otherwise simple left rotation is enough
-            return rotate_left(node);
-        // Left subtree's depth is too big
-        } else if (node_balance == -2) {
-            if (diff(node->left) > 0) {
-                // Left-right rotation: make left-left subtree's depth smaller than left-right subtree's
-                node->left = rotate_left(node->left);
-            }
-            // Otherwise simple right rotation is enough
-            return rotate_right(node);
-        }
-
-        // Both subtrees have right depth's
-        return node;
-    }
-
-    Node* put(Node* node, const ValueType& elem) {
-        if (!node) {
-            auto next = lb(root, elem);
-            iterator it;
-            if (next == end()) {
-                items.push_back(elem);
-                it = --items.cend();
-            } else {
-                it = items.insert(next, elem);
-            }
-            return new Node(elem, it);
-        }
-
-        if (elem < node->val) {
-            node->left = put(node->left, elem);
-        } else {
-            node->right = put(node->right, elem);
-        }
-
-        return balance(node);
-    }
-
-    // Returns minimum in node's subtree
-    Node* find_min(Node* node) {
-        return (node->left ? find_min(node->left) : node);
-    }
-    // Removes minimum from node's subtree
-    Node* remove_min(Node* node) {
-        if (!node->left) {
-            return node->right;
-        }
-
-        node->left = remove_min(node->left);
-        return balance(node);
-    }
-
-    Node* del(Node* node, const ValueType& elem) {
-        if (!node) {
-            return nullptr;
-        }
-
-        if (elem < node->val) {
-            node->left = del(node->left, elem);
-        } else if (node->val < elem) {
-            node->right = del(node->right, elem);
-        } else {
-            // AVL can't delete node directly; instead it would be replaced with minimum in it's right subtree,
-            // and minimum can be easily deleted
-            Node* left = node->left;
-            Node* right = node->right;
-            items.erase(node->iter);
-            delete node;
-            if (!right) {
-                return left;
-            }
-
-            Node* mn = find_min(right);
-            mn->right = remove_min(right);
-            mn->left = left;
-            return balance(mn);
-        }
-
-        return balance(node);
-    }
-
-    iterator search(Node* node, const ValueType& elem) const {
-        if (!node) {
-            return end();
-        }
-
-        if (elem < node->val) {
-            return search(node->left, elem);
-        } else if (node->val < elem) {
-            return search(node->right, elem);
-        } else {
-            return node->iter;
-        }
-    }
-
-    iterator lb(Node* node, const ValueType& elem) const {
-        if (!node) {
-            return end();
-        }
-
-        if (elem < node->val) {
-            iterator left = lb(node->left, elem);
-            return (left == end() ? node->iter : left);
-        } else if (node->val < elem) {
-            return lb(node->right, elem);
-        } else {
-            return node->iter;
-        }
-    }
-};
+/*
+AVL Tree
+Main source: https://habr.com/ru/post/150732/
+Changes:
+1) Intrusive prev/next threading inside Node allows to iterate through the tree
+2) Other minor upgrades added in order to pass the task
+*/
+
+#ifndef AVL_TREE_H
+#define AVL_TREE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <new>
+#include <ostream>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Detects whether std::hash<T> is usable. Value types without a hash still
+// get a fully working Set; they just cannot answer digest()/diff()
+template<typename T>
+class HasStdHash {
+    template<typename U>
+    static auto probe(int)
+        -> decltype(std::declval<std::hash<U> >()(std::declval<const U&>()),
+                    std::true_type());
+    template<typename U>
+    static std::false_type probe(...);
+
+public:
+    static const bool value = decltype(probe<T>(0))::value;
+};
+
+// Tag promising that a constructor input range is already sorted and
+// duplicate-free, enabling the O(n) bulk-load path
+struct sorted_unique_t {};
+
+// Opt-in hot-path instrumentation: compile with -DAVL_SET_STATS and every Set
+// keeps per-instance counters readable through stats(). Without the flag the
+// counting macro expands to nothing and stats() reports zeros, so release
+// builds pay nothing
+struct SetStats {
+    uint64_t comparisons = 0;    // comparator invocations on descent paths
+    uint64_t nodes_visited = 0;  // descent steps across insert/erase/lookups
+    uint64_t rotations = 0;      // single rotations (a double counts as two)
+    uint64_t allocations = 0;    // nodes constructed, including clones
+};
+
+#ifdef AVL_SET_STATS
+#define AVL_STATS_INC(counter) (++stats_.counter)
+#else
+#define AVL_STATS_INC(counter) ((void)0)
+#endif
+
+// Snapshot format: 24-byte header (magic, value size, count) followed by the
+// values in sorted order, native endianness. The same image serves both the
+// deserialize bulk loader and the zero-copy FlatSetView
+enum : uint64_t { FLAT_SET_MAGIC = 0x3150414E534C5641ULL };  // "AVLSNAP1"
+
+// Ordering is provided by Compare; with a transparent comparator (one that
+// defines is_transparent, e.g. std::less<>) the lookup and erase paths accept
+// any probe type the comparator can order against ValueType, so probing a
+// Set<std::string> with a const char* no longer constructs a temporary string
+template<class ValueType, class Compare = std::less<ValueType>>
+class Set {
+private:
+    struct Node;
+
+public:
+    using init_list = std::initializer_list<ValueType>;
+
+    // Walks the intrusive prev/next threading embedded in the tree nodes,
+    // so iteration needs no side container and no extra allocations
+    class iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = ValueType;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const ValueType*;
+        using reference = const ValueType&;
+
+        iterator(): owner(nullptr), node(nullptr) {}
+
+        reference operator * () const {
+            return node->val;
+        }
+        pointer operator -> () const {
+            return &node->val;
+        }
+
+        iterator& operator ++ () {
+            node = node->next();
+            return *this;
+        }
+        iterator operator ++ (int) {
+            iterator old = *this;
+            node = node->next();
+            return old;
+        }
+        iterator& operator -- () {
+            node = (node ? node->prev() : owner->tail);
+            return *this;
+        }
+        iterator operator -- (int) {
+            iterator old = *this;
+            --(*this);
+            return old;
+        }
+
+        // O(log n) repositioning through the order statistics, instead of
+        // n single steps along the threading
+        iterator operator + (difference_type n) const {
+            if (n == 0) {
+                return *this;
+            }
+            size_t pos = (node ? owner->rank(node->val) : owner->size());
+            return owner->nth(pos + n);
+        }
+        iterator operator - (difference_type n) const {
+            return *this + (-n);
+        }
+
+        bool operator == (const iterator& other) const {
+            return node == other.node;
+        }
+        bool operator != (const iterator& other) const {
+            return node != other.node;
+        }
+
+    private:
+        friend class Set;
+
+        iterator(const Set* owner, Node* node): owner(owner), node(node) {}
+
+        const Set* owner;
+        Node* node;
+    };
+
+    // Lightweight half-open view over a key interval: two threading
+    // positions, so building one costs two descents and iterating it walks
+    // the threading with no per-step comparisons
+    class Range {
+    public:
+        iterator begin() const {
+            return first_;
+        }
+        iterator end() const {
+            return last_;
+        }
+        bool empty() const {
+            return first_ == last_;
+        }
+
+    private:
+        friend class Set;
+
+        Range(iterator first, iterator last): first_(first), last_(last) {}
+
+        iterator first_, last_;
+    };
+
+    Set(): root(nullptr), sz(0), head(nullptr), tail(nullptr), blocks(), block_cap(0), block_used(0), free_slots(nullptr), cmp(), lazy(false), dead_cnt(0) {}
+
+    explicit Set(const Compare& comp): Set() {
+        cmp = comp;
+    }
+
+    template<typename Iterator>
+    Set(Iterator first, Iterator last): Set() {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    // Bulk load: builds a height-balanced tree from sorted unique input in O(n),
+    // with no rotations and sequential threading
+    template<typename Iterator>
+    Set(sorted_unique_t, Iterator first, Iterator last): Set() {
+        assign_sorted(first, last);
+    }
+
+    template<typename Iterator>
+    static Set from_sorted(Iterator first, Iterator last) {
+        Set result;
+        result.assign_sorted(first, last);
+        return result;
+    }
+
+    // Parallel bulk load: slices the sorted input into one chunk per worker,
+    // builds every chunk on its own thread in its own arena, then stitches
+    // the parts together — each seam is one threading splice plus an
+    // O(log n) join, so the combine step is negligible next to the builds.
+    // Small inputs fall back to the serial path rather than pay thread spawns
+    template<typename Iterator>
+    static Set from_sorted(Iterator first, Iterator last, unsigned threads) {
+        size_t n = std::distance(first, last);
+        size_t chunks = (n + MIN_PARALLEL_CHUNK - 1) / MIN_PARALLEL_CHUNK;
+        if (threads > chunks) {
+            threads = unsigned(chunks);
+        }
+        if (threads <= 1) {
+            return from_sorted(first, last);
+        }
+
+        std::vector<Set> parts(threads);
+        std::vector<std::thread> workers;
+        workers.reserve(threads);
+        Iterator from = first;
+        for (unsigned i = 0; i < threads; ++i) {
+            size_t len = n / threads + (i < n % threads ? 1 : 0);
+            Iterator to = from;
+            std::advance(to, len);
+            Set* part = &parts[i];
+            workers.emplace_back([part, from, to] {
+                part->assign_sorted(from, to);
+            });
+            from = to;
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        Set result = std::move(parts.front());
+        for (unsigned i = 1; i < threads; ++i) {
+            result.concat(std::move(parts[i]));
+        }
+        return result;
+    }
+
+    Set(const init_list& elems): Set() {
+        for (const auto& elem : elems) {
+            insert(elem);
+        }
+    }
+
+    Set(const Set& other): Set() {
+        assign_copy(other);
+    }
+    Set& operator = (const Set& other) {
+        if (this != &other) {
+            reset();
+            assign_copy(other);
+        }
+
+        return *this;
+    }
+
+    Set(Set&& other) noexcept: Set() {
+        swap(other);
+    }
+    Set& operator = (Set&& other) noexcept {
+        if (this != &other) {
+            reset();
+            swap(other);
+        }
+
+        return *this;
+    }
+
+    ~Set() {
+        reset();
+    }
+
+    void swap(Set& other) {
+        std::swap(root, other.root);
+        std::swap(sz, other.sz);
+        std::swap(head, other.head);
+        std::swap(tail, other.tail);
+        blocks.swap(other.blocks);
+        std::swap(block_cap, other.block_cap);
+        std::swap(block_used, other.block_used);
+        std::swap(free_slots, other.free_slots);
+        std::swap(cmp, other.cmp);
+        std::swap(lazy, other.lazy);
+        std::swap(dead_cnt, other.dead_cnt);
+    }
+
+    size_t size() const {
+        return sz;
+    }
+    bool empty() const {
+        return (sz == 0);
+    }
+
+    void insert(const ValueType &elem) {
+        if (put(elem)) {
+            sz++;
+        }
+    }
+    void insert(ValueType&& elem) {
+        if (put(std::move(elem))) {
+            sz++;
+        }
+    }
+    void erase(const ValueType &elem) {
+        if (lazy ? bury(elem) : del(elem)) {
+            sz--;
+            maybe_compact();
+        }
+
+    }
+
+    // Constructs the value directly inside a fresh node, so there is no
+    // intermediate ValueType at all; if the key turns out to be a duplicate
+    // the node goes back to the free list. Returns the element's iterator
+    template<typename... Args>
+    iterator emplace(Args&&... args) {
+        return emplace_node(new_node(std::forward<Args>(args)...));
+    }
+
+    // Like emplace, but an end() hint from near-sorted ingest turns the
+    // descent into a comparison-free walk down the right spine: one
+    // comparison against tail confirms the append, and the early-exit
+    // rebalancing does amortized O(1) work there. Any other (or stale) hint
+    // just falls back to the full descent
+    template<typename... Args>
+    iterator emplace_hint(iterator hint, Args&&... args) {
+        Node* fresh = new_node(std::forward<Args>(args)...);
+        if (hint.node == nullptr && dead_cnt == 0 && (!tail || cmp(tail->val, fresh->val))) {
+            Node** path[MAX_DEPTH];
+            int depth = 0;
+            Node** link = &root;
+            while (*link) {
+                path[depth++] = link;
+                link = &(*link)->right;
+            }
+            link_before(fresh, nullptr);
+            *link = fresh;
+            rebalance_path(path, depth, +1, fresh->hsum);
+            sz++;
+            return iterator(this, fresh);
+        }
+        return emplace_node(fresh);
+    }
+
+    // Heterogeneous insert/erase, enabled only for transparent comparators.
+    // The probe descends as-is; insert converts it to a ValueType exactly
+    // once, inside the new node, and only when the key turns out to be absent
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    void insert(const K& elem) {
+        if (put(elem)) {
+            sz++;
+        }
+    }
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    void erase(const K& elem) {
+        if (lazy ? bury(elem) : del(elem)) {
+            sz--;
+            maybe_compact();
+        }
+    }
+
+    // Batch insert: sorts and dedupes the batch, then either replays it
+    // element-wise (small batches) or merges it with the existing contents
+    // and bulk-rebuilds in O(n + m), amortizing the tree traversal away
+    template<typename Iterator>
+    void insert(Iterator first, Iterator last) {
+        std::vector<ValueType> batch(first, last);
+        sort_unique(batch);
+        if (batch.empty()) {
+            return;
+        }
+
+        if (batch.size() * BATCH_MERGE_FACTOR < sz) {
+            for (const auto& elem : batch) {
+                insert(elem);
+            }
+            return;
+        }
+
+        std::vector<ValueType> merged;
+        merged.reserve(sz + batch.size());
+        Node* node = head;
+        size_t i = 0;
+        while (node && i < batch.size()) {
+            if (cmp(batch[i], node->val)) {
+                merged.push_back(std::move(batch[i++]));
+            } else {
+                if (!cmp(node->val, batch[i])) {
+                    i++;  // already present
+                }
+                merged.push_back(node->val);
+                node = node->next();
+            }
+        }
+        for (; node; node = node->next()) {
+            merged.push_back(node->val);
+        }
+        for (; i < batch.size(); ++i) {
+            merged.push_back(std::move(batch[i]));
+        }
+
+        reset();
+        assign_sorted(std::make_move_iterator(merged.begin()),
+                      std::make_move_iterator(merged.end()));
+    }
+
+    // Batch erase, with the same small/large split as batch insert
+    template<typename Iterator>
+    void erase(Iterator first, Iterator last) {
+        std::vector<ValueType> batch(first, last);
+        sort_unique(batch);
+        if (batch.empty()) {
+            return;
+        }
+
+        if (batch.size() * BATCH_MERGE_FACTOR < sz) {
+            for (const auto& elem : batch) {
+                erase(elem);
+            }
+            return;
+        }
+
+        std::vector<ValueType> kept;
+        kept.reserve(sz);
+        size_t i = 0;
+        for (Node* node = head; node; node = node->next()) {
+            while (i < batch.size() && cmp(batch[i], node->val)) {
+                i++;
+            }
+            if (i == batch.size() || cmp(node->val, batch[i])) {
+                kept.push_back(node->val);
+            }
+        }
+
+        reset();
+        assign_sorted(std::make_move_iterator(kept.begin()),
+                      std::make_move_iterator(kept.end()));
+    }
+
+    iterator begin() const {
+        return iterator(this, head);
+    }
+    iterator end() const {
+        return iterator(this, nullptr);
+    }
+
+    iterator find(const ValueType& elem) const {
+        return iterator(this, search(elem));
+    }
+
+    // Batched point lookups: descends up to 16 probes in lockstep, one tree
+    // level per round, prefetching every probe's next node before touching
+    // any of them. A lone descent stalls on one cache miss per level; here
+    // the misses of a whole batch overlap, so on out-of-cache trees a batch
+    // resolves severalfold faster than the same probes through find() in a
+    // loop. out[i] gets exactly what find(probes[i]) would return
+    void find_batch(const ValueType* probes, size_t n, iterator* out) const {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = end();
+        }
+        if (!root) {
+            return;
+        }
+        for (size_t base = 0; base < n; base += BATCH_WIDTH) {
+            size_t width = n - base;
+            if (width > BATCH_WIDTH) {
+                width = BATCH_WIDTH;
+            }
+            Node* cur[BATCH_WIDTH];
+            size_t pending = width;
+            for (size_t i = 0; i < width; i++) {
+                cur[i] = root;
+            }
+            __builtin_prefetch(root);
+            while (pending > 0) {
+                for (size_t i = 0; i < width; i++) {
+                    Node* node = cur[i];
+                    if (!node) {
+                        continue;
+                    }
+                    AVL_STATS_INC(nodes_visited);
+                    const ValueType& probe = probes[base + i];
+                    Node* next;
+                    if (less(probe, node->val)) {
+                        next = node->left;
+                    } else if (less(node->val, probe)) {
+                        next = node->right;
+                    } else {
+                        if (!is_dead(node)) {
+                            out[base + i] = iterator(this, node);
+                        }
+                        cur[i] = nullptr;
+                        pending--;
+                        continue;
+                    }
+                    cur[i] = next;
+                    if (next) {
+                        __builtin_prefetch(next);
+                    } else {
+                        pending--;
+                    }
+                }
+            }
+        }
+    }
+
+    iterator lower_bound(const ValueType& elem) const {
+        return iterator(this, lb(elem));
+    }
+    iterator upper_bound(const ValueType& elem) const {
+        return iterator(this, ub(elem));
+    }
+    std::pair<iterator, iterator> equal_range(const ValueType& elem) const {
+        return eq_range(elem);
+    }
+
+    // Heterogeneous lookups, enabled only for transparent comparators
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& elem) const {
+        return iterator(this, search(elem));
+    }
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& elem) const {
+        return iterator(this, lb(elem));
+    }
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator upper_bound(const K& elem) const {
+        return iterator(this, ub(elem));
+    }
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<iterator, iterator> equal_range(const K& elem) const {
+        return eq_range(elem);
+    }
+
+    // View over [lo, hi); inverted bounds yield an empty view
+    Range range(const ValueType& lo, const ValueType& hi) const {
+        if (!less(lo, hi)) {
+            return Range(end(), end());
+        }
+        return Range(iterator(this, lb(lo)), iterator(this, lb(hi)));
+    }
+
+    Compare key_comp() const {
+        return cmp;
+    }
+
+    // Join-based union that consumes other: nodes are stolen, not copied, and
+    // other's arena blocks are adopted so the stolen nodes keep their storage.
+    // Runs in O(m log(n/m + 1)), i.e. linear when the sets are similar in size
+    void merge(Set&& other) {
+        if (this == &other || other.empty()) {
+            return;
+        }
+        compact();
+        other.compact();
+        if (empty()) {
+            swap(other);
+            return;
+        }
+
+        adopt_storage(other);
+        Node* other_root = other.root;
+        other.root = nullptr;
+        other.head = other.tail = nullptr;
+        other.sz = 0;
+
+        root = union_nodes(root, other_root);
+        relink_all();
+        sz = count(root);
+    }
+
+    // Splits off every element not less than elem into the returned set, in
+    // O(log n) tree surgery plus O(k) for building the detached part. The
+    // detached values are copied out because their nodes live in this set's
+    // arena and cannot change owner one by one
+    Set split(const ValueType& elem) {
+        compact();
+        Set high(cmp);
+        Node* cut = lb(elem);
+        if (!cut) {
+            return high;
+        }
+
+        std::vector<ValueType> vals;
+        for (Node* node = cut; node; node = node->next()) {
+            vals.push_back(node->val);
+        }
+        high.assign_sorted(vals.begin(), vals.end());
+
+        // cut is destroyed with the high part below; its predecessor must be
+        // captured while the threading is still intact
+        Node* last_low = cut->prev();
+
+        Node* low_part;
+        Node* high_part;
+        split_nodes(root, elem, low_part, high_part, false);
+        root = low_part;
+        destroy_subtree(high_part);
+
+        if (last_low) {
+            last_low->set_next(nullptr);
+        } else {
+            head = nullptr;
+        }
+        tail = last_low;
+        sz = count(root);
+        return high;
+    }
+
+    // Writes the flat snapshot format; only byte-copyable values can be dumped
+    void serialize(std::ostream& out) const {
+        static_assert(std::is_trivially_copyable<ValueType>::value,
+                      "serialization needs a trivially copyable ValueType");
+        uint64_t header[3] = {FLAT_SET_MAGIC, sizeof(ValueType), sz};
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        for (Node* node = head; node; node = node->next()) {
+            out.write(reinterpret_cast<const char*>(&node->val), sizeof(ValueType));
+        }
+    }
+
+    // Bulk-builds from a snapshot in O(n); a malformed image sets failbit on
+    // the stream and yields an empty set
+    static Set deserialize(std::istream& in) {
+        static_assert(std::is_trivially_copyable<ValueType>::value,
+                      "serialization needs a trivially copyable ValueType");
+        Set result;
+        uint64_t header[3];
+        in.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (!in || header[0] != FLAT_SET_MAGIC || header[1] != sizeof(ValueType)) {
+            in.setstate(std::ios_base::failbit);
+            return result;
+        }
+        // The count field is untrusted: grow towards it in bounded chunks so
+        // a corrupt header can't provoke a giant up-front allocation — a
+        // short stream fails the read long before the count is reached
+        std::vector<ValueType> vals;
+        uint64_t total = header[2];
+        uint64_t done = 0;
+        while (done < total) {
+            uint64_t want = total - done;
+            if (want > DESERIALIZE_CHUNK) {
+                want = DESERIALIZE_CHUNK;
+            }
+            vals.resize(size_t(done + want));
+            in.read(reinterpret_cast<char*>(vals.data() + done),
+                    std::streamsize(want * sizeof(ValueType)));
+            if (!in) {
+                return result;  // the short read already set failbit
+            }
+            done += want;
+        }
+        result.assign_sorted(vals.begin(), vals.end());
+        return result;
+    }
+
+    // k-th smallest element (0-based) in O(log n), end() if k >= size()
+    iterator nth(size_t k) const {
+        if (k >= sz) {
+            return end();
+        }
+        Node* node = root;
+        while (true) {
+            size_t left_cnt = count(node->left);
+            size_t self = (is_dead(node) ? 0 : 1);
+            if (k < left_cnt) {
+                node = node->left;
+            } else if (self && k == left_cnt) {
+                return iterator(this, node);
+            } else {
+                k -= left_cnt + self;
+                node = node->right;
+            }
+        }
+    }
+    // Number of elements strictly less than elem, in O(log n)
+    size_t rank(const ValueType& elem) const {
+        return rank_of(elem);
+    }
+
+    // Ordered visit of every element. Walks the threading while keeping a
+    // software prefetch a fixed distance ahead, so the next nodes' cache
+    // misses overlap the callback instead of stalling it; right after a bulk
+    // load or repack the threading order coincides with arena order and the
+    // walk becomes a plain linear sweep
+    template<typename F>
+    void for_each(F f) const {
+        scan_nodes(head, nullptr, f);
+    }
+
+    // Prefetched ordered visit of [lo, hi): two descents pin the ends, the
+    // walk itself does no comparisons
+    template<typename F>
+    void scan(const ValueType& lo, const ValueType& hi, F f) const {
+        if (!less(lo, hi)) {
+            return;
+        }
+        scan_nodes(lb(lo), lb(hi), f);
+    }
+
+    // Number of elements in [lo, hi) as a rank difference: two O(log n)
+    // descents through the subtree counts, never a walk over the interval
+    size_t count_between(const ValueType& lo, const ValueType& hi) const {
+        if (!less(lo, hi)) {
+            return 0;
+        }
+        return rank(hi) - rank(lo);
+    }
+
+    // Whole-set content fingerprint in O(1): the per-subtree hash sums are
+    // maintained alongside the counts, so two replicas over the same element
+    // hash compare equal by one 64-bit comparison (up to hash collisions)
+    uint64_t digest() const {
+        static_assert(HasStdHash<ValueType>::value,
+                      "digest() needs a std::hash specialization for ValueType");
+        return hash_sum(root);
+    }
+
+    // Fingerprint of [lo, hi) as a prefix-digest difference, in the mould of
+    // count_between: addition commutes, so the sum below hi minus the sum
+    // below lo is exactly the range's digest, two O(log n) descents
+    uint64_t digest_between(const ValueType& lo, const ValueType& hi) const {
+        static_assert(HasStdHash<ValueType>::value,
+                      "digest_between() needs a std::hash specialization for ValueType");
+        if (!less(lo, hi)) {
+            return 0;
+        }
+        return digest_below(hi) - digest_below(lo);
+    }
+
+    // Emits the symmetric difference against other as (value, mine) pairs,
+    // mine set on elements only this set holds. Divergent key ranges are
+    // located by comparing range digests and halving, so matching regions are
+    // skipped wholesale and the cost scales with the size of the delta (times
+    // polylog factors), not with the size of the replicas
+    template<typename OutputIterator>
+    void diff(const Set& other, OutputIterator out) const {
+        static_assert(HasStdHash<ValueType>::value,
+                      "diff() needs a std::hash specialization for ValueType");
+        diff_ranges(other, nullptr, nullptr, out);
+    }
+
+    // Lazy deletion for churn-heavy workloads: with the mode on, erase only
+    // tombstones the node in O(log n) — no rotations, no successor surgery —
+    // and re-inserting the key revives the node in place with no allocation.
+    // Tombstones vanish automatically once they outnumber the live elements,
+    // or on an explicit compact()
+    void set_lazy_erase(bool on) {
+        lazy = on;
+    }
+    size_t tombstones() const {
+        return dead_cnt;
+    }
+
+    // Rebuilds without the tombstones through the same copy-and-bulk-load
+    // idiom the batch paths use, releasing the old arena blocks
+    void compact() {
+        if (dead_cnt == 0) {
+            return;
+        }
+        std::vector<ValueType> vals;
+        vals.reserve(sz);
+        for (Node* node = head; node; node = node->next()) {
+            vals.push_back(node->val);
+        }
+        bool keep_lazy = lazy;
+        reset();
+        lazy = keep_lazy;
+        assign_sorted(std::make_move_iterator(vals.begin()),
+                      std::make_move_iterator(vals.end()));
+    }
+
+    // Rewrites the nodes into a fresh arena in breadth-first order, so the
+    // top levels — the part every descent touches — share a few cache lines
+    // and pages again after churn has scattered the allocation order.
+    // Topology, heights and counts are preserved exactly; only placement
+    // changes, in one O(n) pass with no per-element descent. With a level
+    // budget (levels > 0) only the top of the tree is rewritten and the deep
+    // subtrees are spliced across untouched, which caps the pass at roughly
+    // 2^levels nodes and can be repeated to spread the work out; most of the
+    // locality win lives in those top levels anyway
+    void repack(int levels = 0) {
+        if (empty()) {
+            return;
+        }
+        compact();  // tombstones would only be dragged along
+
+        Set fresh(cmp);
+        fresh.lazy = lazy;
+        int copy_depth = (levels <= 0 ? height() : levels);
+
+        struct Item {
+            Node* src;
+            Node** slot;
+            int depth;
+        };
+        std::vector<Item> queue;
+        std::vector<Node*> replaced;
+        queue.push_back(Item{root, &fresh.root, 0});
+        bool partial = false;
+        for (size_t i = 0; i < queue.size(); ++i) {
+            Item item = queue[i];
+            if (item.depth >= copy_depth) {
+                partial = true;
+                *item.slot = item.src;  // deep subtree spliced as is
+                continue;
+            }
+            Node* copy = fresh.new_node(item.src->val);
+            copy->set_height(item.src->height());
+            copy->cnt = item.src->cnt;
+            copy->hsum = item.src->hsum;
+            *item.slot = copy;
+            replaced.push_back(item.src);
+            if (item.src->left) {
+                queue.push_back(Item{item.src->left, &copy->left, item.depth + 1});
+            }
+            if (item.src->right) {
+                queue.push_back(Item{item.src->right, &copy->right, item.depth + 1});
+            }
+        }
+        fresh.sz = sz;
+
+        if (partial) {
+            // the deep nodes stay put, so their blocks move over wholesale
+            // and only the rewritten originals are returned to the free list
+            fresh.adopt_storage(*this);
+            for (Node* src : replaced) {
+                fresh.free_node(src);
+            }
+            fresh.relink_all();
+            root = nullptr;
+            head = tail = nullptr;
+            sz = 0;
+        } else {
+            fresh.relink_all();
+            reset();
+        }
+        swap(fresh);
+    }
+
+    // All zeros unless the translation unit was built with -DAVL_SET_STATS
+    SetStats stats() const {
+#ifdef AVL_SET_STATS
+        return stats_;
+#else
+        return SetStats();
+#endif
+    }
+    void reset_stats() {
+#ifdef AVL_SET_STATS
+        stats_ = SetStats();
+#endif
+    }
+
+    int height() const {
+        return height(root);
+    }
+
+    // Full structural audit for debug builds: BST ordering, exact heights and
+    // AVL balance, order-statistic counts, and the prev/next threading. O(n)
+    bool check_invariants() const {
+        size_t seen = 0;
+        if (!check_subtree(root, nullptr, nullptr, seen) || seen != sz) {
+            return false;
+        }
+        size_t walked = 0;
+        Node* last = nullptr;
+        for (Node* node = head; node; node = node->next()) {
+            if (node->prev() != last || (last && !cmp(last->val, node->val))) {
+                return false;
+            }
+            last = node;
+            if (++walked > sz) {
+                return false;
+            }
+        }
+        return (last == tail && walked == sz);
+    }
+
+private:
+    struct Node {
+        const ValueType val;
+        // Subtree size for order statistics; uint32_t rides in the padding
+        // after small values and caps the set at 2^32-1 elements
+        uint32_t cnt;
+        // Sum (mod 2^64) of the mixed hashes of every alive element in the
+        // subtree. Addition commutes, so equal content gives equal sums no
+        // matter how the two trees are shaped — the basis of digest()
+        uint64_t hsum;
+        Node* left, *right;
+        // In-order threading. Nodes are at least 8-byte aligned, so the three
+        // low bits of each pointer are free; together they hold the node's
+        // height (6 bits, plenty: an AVL of height 64 needs over 2^44 nodes),
+        // which keeps the metadata from costing a padded-out extra word
+        uintptr_t prev_bits, next_bits;
+
+        template<typename... Args>
+        Node(Args&&... args): val(std::forward<Args>(args)...), cnt(1), left(nullptr), right(nullptr), prev_bits(0), next_bits(0) {
+            set_height(1);
+            hsum = elem_hash(val);
+        }
+
+        Node* prev() const {
+            return reinterpret_cast<Node*>(prev_bits & ~uintptr_t(7));
+        }
+        Node* next() const {
+            return reinterpret_cast<Node*>(next_bits & ~uintptr_t(7));
+        }
+        void set_prev(Node* node) {
+            prev_bits = reinterpret_cast<uintptr_t>(node) | (prev_bits & 7);
+        }
+        void set_next(Node* node) {
+            next_bits = reinterpret_cast<uintptr_t>(node) | (next_bits & 7);
+        }
+
+        int height() const {
+            return int(prev_bits & 7) | (int(next_bits & 7) << 3);
+        }
+        void set_height(int h) {
+            prev_bits = (prev_bits & ~uintptr_t(7)) | uintptr_t(h & 7);
+            next_bits = (next_bits & ~uintptr_t(7)) | uintptr_t((h >> 3) & 7);
+        }
+    };
+    static_assert(alignof(Node) >= 8, "height packing needs the node alignment bits");
+
+    // Nodes are carved out of geometrically growing slab blocks and recycled
+    // through a free list, so insert/erase don't hit the heap every time and
+    // teardown frees whole blocks instead of node-by-node deletes
+    union Slot {
+        Slot* next_free;  // valid only while the slot is on the free list
+        typename std::aligned_storage<sizeof(Node), alignof(Node)>::type storage;
+    };
+
+    enum : size_t { FIRST_BLOCK_SLOTS = 16, MAX_BLOCK_SLOTS = 4096 };
+
+    // Batches at least this many times smaller than the set are replayed
+    // element-wise; larger ones go through the O(n + m) merge rebuild
+    enum : size_t { BATCH_MERGE_FACTOR = 8 };
+
+    // Minimum per-worker slice for the parallel bulk load; below this the
+    // serial build beats the cost of spawning threads
+    enum : size_t { MIN_PARALLEL_CHUNK = 16384 };
+
+    // An AVL tree of height h has at least F(h+2)-1 nodes, so 96 levels are
+    // enough for any set that fits in memory; used for the explicit
+    // rebalancing stacks that replace recursion on the modify paths
+    enum { MAX_DEPTH = 96 };
+    // Elements per read while deserializing an untrusted count field
+    enum : uint64_t { DESERIALIZE_CHUNK = 4096 };
+
+    Node* root;
+    size_t sz;
+    Node* head, *tail;  // ends of the in-order threading
+    std::vector<Slot*> blocks;
+    size_t block_cap;   // capacity of the last allocated block
+    size_t block_used;  // slots handed out from the last block
+    Slot* free_slots;
+    Compare cmp;
+    bool lazy;        // erase tombstones instead of restructuring
+    size_t dead_cnt;  // tombstoned nodes still sitting in the tree
+#ifdef AVL_SET_STATS
+    mutable SetStats stats_;  // mutable so const lookups count too
+#endif
+
+    // All hot-path ordering goes through here so the comparison counter sees it
+    template<typename A, typename B>
+    bool less(const A& a, const B& b) const {
+        AVL_STATS_INC(comparisons);
+        return cmp(a, b);
+    }
+
+    bool check_subtree(Node* node, const ValueType* lo, const ValueType* hi, size_t& seen) const {
+        if (!node) {
+            return true;
+        }
+        if ((lo && !cmp(*lo, node->val)) || (hi && !cmp(node->val, *hi))) {
+            return false;
+        }
+        if (!check_subtree(node->left, lo, &node->val, seen) ||
+            !check_subtree(node->right, &node->val, hi, seen)) {
+            return false;
+        }
+        int balance_diff = height(node->right) - height(node->left);
+        if (node->height() != 1 + std::max(height(node->left), height(node->right)) ||
+            balance_diff < -1 || balance_diff > 1) {
+            return false;
+        }
+        if (node->cnt != (is_dead(node) ? 0 : 1) + count(node->left) + count(node->right)) {
+            return false;
+        }
+        if (node->hsum != (is_dead(node) ? 0 : elem_hash(node->val)) +
+                          hash_sum(node->left) + hash_sum(node->right)) {
+            return false;
+        }
+        if (!is_dead(node)) {
+            ++seen;
+        }
+        return true;
+    }
+
+    // Sorts a batch by the set's order and drops comparator-equivalent
+    // duplicates (operator == is never required of ValueType)
+    void sort_unique(std::vector<ValueType>& batch) const {
+        std::sort(batch.begin(), batch.end(), cmp);
+        batch.erase(std::unique(batch.begin(), batch.end(),
+                                [this](const ValueType& x, const ValueType& y) {
+                                    return !cmp(x, y) && !cmp(y, x);
+                                }),
+                    batch.end());
+    }
+
+    template<typename... Args>
+    Node* new_node(Args&&... args) {
+        Slot* slot;
+        if (free_slots) {
+            slot = free_slots;
+            free_slots = slot->next_free;
+        } else {
+            if (blocks.empty() || block_used == block_cap) {
+                block_cap = (blocks.empty() ? size_t(FIRST_BLOCK_SLOTS) : std::min(block_cap * 2, size_t(MAX_BLOCK_SLOTS)));
+                blocks.push_back(static_cast<Slot*>(operator new(block_cap * sizeof(Slot))));
+                block_used = 0;
+            }
+            slot = blocks.back() + block_used++;
+        }
+        AVL_STATS_INC(allocations);
+        return new (&slot->storage) Node(std::forward<Args>(args)...);
+    }
+    void free_node(Node* node) {
+        node->~Node();
+        Slot* slot = reinterpret_cast<Slot*>(node);
+        slot->next_free = free_slots;
+        free_slots = slot;
+    }
+    void release_blocks() {
+        for (Slot* block : blocks) {
+            operator delete(block);
+        }
+        blocks.clear();
+        block_cap = 0;
+        block_used = 0;
+        free_slots = nullptr;
+    }
+
+    // Splices node into the threading right before next_node (or at the very end)
+    void link_before(Node* node, Node* next_node) {
+        Node* before = (next_node ? next_node->prev() : tail);
+        node->set_next(next_node);
+        node->set_prev(before);
+        if (before) {
+            before->set_next(node);
+        } else {
+            head = node;
+        }
+        if (next_node) {
+            next_node->set_prev(node);
+        } else {
+            tail = node;
+        }
+    }
+    void unlink(Node* node) {
+        Node* before = node->prev();
+        Node* after = node->next();
+        if (before) {
+            before->set_next(after);
+        } else {
+            head = after;
+        }
+        if (after) {
+            after->set_prev(before);
+        } else {
+            tail = before;
+        }
+    }
+
+    // Only destroys the values: the memory itself is dropped in bulk by release_blocks.
+    // Walks the threading instead of the tree, so teardown needs no stack at all
+    void destroy_values() {
+        if (dead_cnt) {
+            destroy_tree_values(root);  // tombstones are off the threading
+            return;
+        }
+        for (Node* node = head; node; ) {
+            Node* next = node->next();
+            node->~Node();
+            node = next;
+        }
+    }
+    void destroy_tree_values(Node* node) {
+        if (!node) {
+            return;
+        }
+        destroy_tree_values(node->left);
+        destroy_tree_values(node->right);
+        node->~Node();
+    }
+
+    static int height(Node* node) {
+        return (node ? node->height() : 0);
+    }
+    // A tombstoned node is unlinked from the threading and marked by the
+    // only prev value an alive node can never have: itself
+    static bool is_dead(Node* node) {
+        return node->prev() == node;
+    }
+    static size_t count(Node* node) {
+        return (node ? node->cnt : 0);
+    }
+    static uint64_t hash_sum(Node* node) {
+        return (node ? node->hsum : 0);
+    }
+    // Per-element fingerprint: std::hash pushed through a 64-bit finalizer,
+    // so even identity hashes (integers) spread over the whole word and the
+    // additive subtree sums don't collide on dense keys
+    static uint64_t elem_hash(const ValueType& elem) {
+        return elem_hash_impl(elem, std::integral_constant<bool, HasStdHash<ValueType>::value>());
+    }
+    static uint64_t elem_hash_impl(const ValueType& elem, std::true_type) {
+        uint64_t x = std::hash<ValueType>()(elem);
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+    // No std::hash for this type: every fingerprint degenerates to zero
+    static uint64_t elem_hash_impl(const ValueType&, std::false_type) {
+        return 0;
+    }
+    int diff(Node* node) {
+        return (node ? height(node->right) - height(node->left) : 0);
+    }
+    void relax(Node* node) {
+        node->set_height(1 + std::max(height(node->left), height(node->right)));
+        node->cnt = uint32_t((is_dead(node) ? 0 : 1) + count(node->left) + count(node->right));
+        node->hsum = (is_dead(node) ? 0 : elem_hash(node->val)) +
+                     hash_sum(node->left) + hash_sum(node->right);
+    }
+
+    // Left rotation
+    Node* rotate_left(Node* node) {
+        AVL_STATS_INC(rotations);
+        Node* center = node->right;
+        node->right = center->left;
+        center->left = node;
+        relax(node);
+        relax(center);
+        return center;
+    }
+    // Right rotation
+    Node* rotate_right(Node *node) {
+        AVL_STATS_INC(rotations);
+        Node* center = node->left;
+        node->left = center->right;
+        center->right = node;
+        relax(node);
+        relax(center);
+        return center;
+    }
+
+    // Main AVL function: fix tree's balance
+    Node* balance(Node* node) {
+        relax(node);
+        int node_balance = diff(node);
+        // Right subtree's depth is too big
+        if (node_balance == 2) {
+            if (diff(node->right) < 0) {
+                // Right-left rotation: make right-right subtree's depth bigger than right-left subtree's
+                node->right = rotate_right(node->right);
+            }
+            // Otherwise simple left rotation is enough
+            return rotate_left(node);
+        // Left subtree's depth is too big
+        } else if (node_balance == -2) {
+            if (diff(node->left) > 0) {
+                // Left-right rotation: make left-left subtree's depth smaller than left-right subtree's
+                node->left = rotate_left(node->left);
+            }
+            // Otherwise simple right rotation is enough
+            return rotate_right(node);
+        }
+
+        // Both subtrees have right depth's
+        return node;
+    }
+
+    // Recursively builds a height-balanced subtree of n elements, consuming the
+    // iterator in sorted order and appending each node to the threading as it
+    // is created; recursion depth is only O(log n)
+    template<typename Iterator>
+    Node* build_balanced(Iterator& it, size_t n, Node*& last) {
+        if (n == 0) {
+            return nullptr;
+        }
+
+        Node* left = build_balanced(it, n / 2, last);
+        Node* node = new_node(*it);
+        ++it;
+
+        node->left = left;
+        node->set_prev(last);
+        if (last) {
+            last->set_next(node);
+        } else {
+            head = node;
+        }
+        last = node;
+
+        node->right = build_balanced(it, n - n / 2 - 1, last);
+        relax(node);
+        return node;
+    }
+
+    // Structural O(n) clone: mirrors the source topology (heights included) and
+    // rebuilds the threading during the same in-order pass, instead of paying a
+    // full descent plus rebalancing per element
+    Node* clone(Node* node, Node*& last) {
+        if (!node) {
+            return nullptr;
+        }
+
+        Node* left = clone(node->left, last);
+        Node* copy = new_node(node->val);
+        copy->set_height(node->height());
+        copy->cnt = node->cnt;
+        copy->hsum = node->hsum;
+
+        copy->left = left;
+        if (is_dead(node)) {
+            copy->set_prev(copy);  // tombstones clone as tombstones
+        } else {
+            copy->set_prev(last);
+            if (last) {
+                last->set_next(copy);
+            } else {
+                head = copy;
+            }
+            last = copy;
+        }
+
+        copy->right = clone(node->right, last);
+        return copy;
+    }
+
+    void assign_copy(const Set& other) {
+        cmp = other.cmp;
+        lazy = other.lazy;
+        dead_cnt = other.dead_cnt;
+        Node* last_linked = nullptr;
+        root = clone(other.root, last_linked);
+        tail = last_linked;
+        sz = other.sz;
+    }
+
+    void reset() {
+        destroy_values();
+        root = nullptr;
+        sz = 0;
+        dead_cnt = 0;
+        head = tail = nullptr;
+        release_blocks();
+    }
+
+    template<typename Iterator>
+    void assign_sorted(Iterator first, Iterator last) {
+        size_t n = std::distance(first, last);
+        Node* last_linked = nullptr;
+        root = build_balanced(first, n, last_linked);
+        tail = last_linked;
+        sz = n;
+    }
+
+    // Joins l < k < r into one balanced tree, reusing k as the pivot node;
+    // costs O(|height(l) - height(r)|)
+    Node* join_nodes(Node* l, Node* k, Node* r) {
+        int hl = height(l);
+        int hr = height(r);
+        if (hl - hr >= -1 && hl - hr <= 1) {
+            k->left = l;
+            k->right = r;
+            relax(k);
+            return k;
+        }
+
+        if (hl > hr) {
+            l->right = join_nodes(l->right, k, r);
+            return balance(l);
+        }
+        r->left = join_nodes(l, k, r->left);
+        return balance(r);
+    }
+
+    // Splits t by key: l gets everything less, r everything greater. A node
+    // equal to key is freed when drop_equal is set (union dedup), otherwise
+    // it goes to the r side
+    void split_nodes(Node* t, const ValueType& key, Node*& l, Node*& r, bool drop_equal) {
+        if (!t) {
+            l = nullptr;
+            r = nullptr;
+            return;
+        }
+
+        if (cmp(t->val, key)) {
+            Node* mid;
+            split_nodes(t->right, key, mid, r, drop_equal);
+            Node* tl = t->left;
+            l = join_nodes(tl, t, mid);
+        } else if (cmp(key, t->val)) {
+            Node* mid;
+            split_nodes(t->left, key, l, mid, drop_equal);
+            Node* tr = t->right;
+            r = join_nodes(mid, t, tr);
+        } else {
+            l = t->left;
+            if (drop_equal) {
+                r = t->right;
+                free_node(t);
+            } else {
+                Node* tr = t->right;
+                t->left = nullptr;
+                relax(t);
+                r = (tr ? join_nodes(nullptr, t, tr) : t);
+            }
+        }
+    }
+
+    // Join-based union; consumes the structure of both inputs and keeps this
+    // set's copy of any key present in both
+    Node* union_nodes(Node* a, Node* b) {
+        if (!a) {
+            return b;
+        }
+        if (!b) {
+            return a;
+        }
+
+        Node* bl;
+        Node* br;
+        split_nodes(b, a->val, bl, br, true);
+        Node* l = union_nodes(a->left, bl);
+        Node* r = union_nodes(a->right, br);
+        return join_nodes(l, a, r);
+    }
+
+    // Rebuilds the in-order threading from scratch after structure surgery
+    void relink_all() {
+        head = tail = nullptr;
+        Node* last = nullptr;
+        relink_walk(root, last);
+        tail = last;
+    }
+    void relink_walk(Node* node, Node*& last) {
+        if (!node) {
+            return;
+        }
+        relink_walk(node->left, last);
+        node->set_prev(last);
+        node->set_next(nullptr);
+        if (last) {
+            last->set_next(node);
+        } else {
+            head = node;
+        }
+        last = node;
+        relink_walk(node->right, last);
+    }
+
+    // Takes over other's arena so nodes stolen from it stay alive; other is
+    // left with no storage of its own
+    void adopt_storage(Set& other) {
+        // Unused slots at the end of other's open block would otherwise leak
+        // until teardown; put them on the free list
+        if (!other.blocks.empty()) {
+            Slot* open_block = other.blocks.back();
+            for (size_t i = other.block_used; i < other.block_cap; ++i) {
+                open_block[i].next_free = free_slots;
+                free_slots = &open_block[i];
+            }
+        }
+        if (other.free_slots) {
+            Slot* last_free = other.free_slots;
+            while (last_free->next_free) {
+                last_free = last_free->next_free;
+            }
+            last_free->next_free = free_slots;
+            free_slots = other.free_slots;
+        }
+        // Our open block must stay last, so other's blocks go in front
+        blocks.insert(blocks.begin(), other.blocks.begin(), other.blocks.end());
+
+        other.blocks.clear();
+        other.block_cap = 0;
+        other.block_used = 0;
+        other.free_slots = nullptr;
+    }
+
+    // Appends a whole set whose every element is greater than every element
+    // here: adopt its arena, splice the two threadings at the seam, detach
+    // its minimum to serve as the join pivot, and join the trees. O(log n)
+    void concat(Set&& other) {
+        if (other.empty()) {
+            return;
+        }
+        if (empty()) {
+            swap(other);
+            return;
+        }
+
+        adopt_storage(other);
+        tail->set_next(other.head);
+        other.head->set_prev(tail);
+        tail = other.tail;
+        sz += other.sz;
+
+        Node* other_root = other.root;
+        other.root = nullptr;
+        other.head = other.tail = nullptr;
+        other.sz = 0;
+
+        Node** path[MAX_DEPTH];
+        int depth = 0;
+        Node** cur = &other_root;
+        while ((*cur)->left) {
+            path[depth++] = cur;
+            cur = &(*cur)->left;
+        }
+        Node* pivot = *cur;
+        *cur = pivot->right;  // detaches through other_root itself when the root is the minimum
+        rebalance_path(path, depth, -1, 0 - elem_hash(pivot->val));
+        root = join_nodes(root, pivot, other_root);
+    }
+
+    void destroy_subtree(Node* node) {
+        if (!node) {
+            return;
+        }
+        destroy_subtree(node->left);
+        destroy_subtree(node->right);
+        free_node(node);
+    }
+
+    // Rebalances bottom-up along a recorded descent path, stopping as soon as a
+    // subtree comes out at its pre-modification height: from that point on the
+    // ancestors' heights and balance factors cannot have changed. Subtree
+    // sizes change all the way up, so above the early exit only the count
+    // delta (+1 insert, -1 erase) keeps propagating
+    void rebalance_path(Node*** path, int depth, int delta, uint64_t hdelta) {
+        while (depth > 0) {
+            Node** slot = path[--depth];
+            int old_h = (*slot)->height();  // not yet relaxed, so this is the old height
+            *slot = balance(*slot);
+            if ((*slot)->height() == old_h) {
+                break;
+            }
+        }
+        while (depth > 0) {
+            Node* node = *path[--depth];
+            node->cnt += uint32_t(delta);
+            node->hsum += hdelta;
+        }
+    }
+
+    // Single-descent insert: one walk checks existence, finds the in-order
+    // successor for the threading, and records the rebalancing path.
+    // Returns false if the key was already present. The probe is only
+    // converted (or moved) into a ValueType inside the freshly built node
+    template<typename K>
+    bool put(K&& elem) {
+        Node** path[MAX_DEPTH];
+        int depth = 0;
+
+        Node* succ = nullptr;  // last node the descent turned left at
+        Node** link = &root;
+        while (*link) {
+            Node* node = *link;
+            AVL_STATS_INC(nodes_visited);
+            if (less(elem, node->val)) {
+                succ = node;
+                path[depth++] = link;
+                link = &node->left;
+            } else if (less(node->val, elem)) {
+                path[depth++] = link;
+                link = &node->right;
+            } else {
+                if (is_dead(node)) {
+                    revive(node, path, depth);
+                    return true;
+                }
+                return false;
+            }
+        }
+
+        if (succ && is_dead(succ)) {
+            // The structural successor is a tombstone, which lives outside
+            // the threading; link before the first alive element instead
+            succ = nth(rank_of(elem)).node;
+        }
+        Node* fresh = new_node(std::forward<K>(elem));
+        link_before(fresh, succ);
+        *link = fresh;
+
+        rebalance_path(path, depth, +1, fresh->hsum);
+        return true;
+    }
+
+    // Tombstone removal: one descent, no restructuring. The node leaves the
+    // threading, self-marks dead, and the alive counts along the path drop
+    template<typename K>
+    bool bury(const K& elem) {
+        Node* path[MAX_DEPTH];
+        int depth = 0;
+
+        Node* node = root;
+        while (node) {
+            AVL_STATS_INC(nodes_visited);
+            if (less(elem, node->val)) {
+                path[depth++] = node;
+                node = node->left;
+            } else if (less(node->val, elem)) {
+                path[depth++] = node;
+                node = node->right;
+            } else {
+                break;
+            }
+        }
+        if (!node || is_dead(node)) {
+            return false;
+        }
+
+        unlink(node);
+        node->set_prev(node);
+        node->set_next(nullptr);
+        uint64_t gone = elem_hash(node->val);
+        node->cnt--;
+        node->hsum -= gone;
+        while (depth > 0) {
+            Node* up = path[--depth];
+            up->cnt--;
+            up->hsum -= gone;
+        }
+        dead_cnt++;
+        return true;
+    }
+
+    // Brings a tombstoned key back without touching the structure or the
+    // arena: the alive successor comes from the dead-aware rank, the node
+    // relinks into the threading there, and the alive counts are restored
+    void revive(Node* node, Node*** path, int depth) {
+        Node* after = nth(rank_of(node->val)).node;
+        link_before(node, after);
+        uint64_t back = elem_hash(node->val);
+        node->cnt++;
+        node->hsum += back;
+        while (depth > 0) {
+            Node* up = *path[--depth];
+            up->cnt++;
+            up->hsum += back;
+        }
+        dead_cnt--;
+    }
+
+    // Descent for an already-built node; duplicates return the node to the
+    // free list and yield the existing element
+    iterator emplace_node(Node* fresh) {
+        const ValueType& elem = fresh->val;
+        Node** path[MAX_DEPTH];
+        int depth = 0;
+
+        Node* succ = nullptr;
+        Node** link = &root;
+        while (*link) {
+            Node* node = *link;
+            AVL_STATS_INC(nodes_visited);
+            if (less(elem, node->val)) {
+                succ = node;
+                path[depth++] = link;
+                link = &node->left;
+            } else if (less(node->val, elem)) {
+                path[depth++] = link;
+                link = &node->right;
+            } else {
+                free_node(fresh);
+                if (is_dead(node)) {
+                    revive(node, path, depth);
+                    sz++;
+                }
+                return iterator(this, node);
+            }
+        }
+
+        if (succ && is_dead(succ)) {
+            succ = nth(rank_of(fresh->val)).node;
+        }
+        link_before(fresh, succ);
+        *link = fresh;
+
+        rebalance_path(path, depth, +1, fresh->hsum);
+        sz++;
+        return iterator(this, fresh);
+    }
+
+    // Single-descent removal; returns false if the key was not there
+    template<typename K>
+    bool del(const K& elem) {
+        Node** path[MAX_DEPTH];
+        int depth = 0;
+
+        Node** link = &root;
+        while (*link) {
+            Node* node = *link;
+            AVL_STATS_INC(nodes_visited);
+            if (less(elem, node->val)) {
+                path[depth++] = link;
+                link = &node->left;
+            } else if (less(node->val, elem)) {
+                path[depth++] = link;
+                link = &node->right;
+            } else {
+                break;
+            }
+        }
+        if (!*link || is_dead(*link)) {
+            return false;
+        }
+
+        Node* node = *link;
+        Node* left = node->left;
+        Node* right = node->right;
+        uint64_t gone = elem_hash(node->val);
+        unlink(node);
+        free_node(node);
+
+        if (!right) {
+            *link = left;
+        } else {
+            // AVL can't delete node directly; instead it is replaced with the
+            // minimum of its right subtree, and the minimum is easy to detach
+            Node* mn;
+            if (!right->left) {
+                mn = right;
+            } else {
+                Node** mn_path[MAX_DEPTH];
+                int mn_depth = 0;
+
+                Node** cur = &right->left;
+                while ((*cur)->left) {
+                    mn_path[mn_depth++] = cur;
+                    cur = &(*cur)->left;
+                }
+                mn = *cur;
+                *cur = mn->right;
+                // a tombstoned minimum moves but carries no alive weight
+                uint64_t mn_hash = (is_dead(mn) ? 0 : elem_hash(mn->val));
+                rebalance_path(mn_path, mn_depth, is_dead(mn) ? 0 : -1, 0 - mn_hash);
+                right = balance(right);
+                mn->right = right;
+            }
+            mn->left = left;
+            *link = balance(mn);
+        }
+
+        rebalance_path(path, depth, -1, 0 - gone);
+        return true;
+    }
+
+    template<typename K>
+    Node* search(const K& elem) const {
+        Node* node = root;
+        while (node) {
+            AVL_STATS_INC(nodes_visited);
+            if (less(elem, node->val)) {
+                node = node->left;
+            } else if (less(node->val, elem)) {
+                node = node->right;
+            } else {
+                return (is_dead(node) ? nullptr : node);
+            }
+        }
+        return nullptr;
+    }
+
+    // Alive elements strictly below elem; the dead-aware twin of rank
+    template<typename K>
+    size_t rank_of(const K& elem) const {
+        size_t result = 0;
+        Node* node = root;
+        while (node) {
+            AVL_STATS_INC(nodes_visited);
+            if (less(node->val, elem)) {
+                result += count(node->left) + (is_dead(node) ? 0 : 1);
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return result;
+    }
+
+    // Digest of every alive element less than elem: one descent, summing the
+    // bypassed left subtrees the way rank sums their counts
+    uint64_t digest_below(const ValueType& elem) const {
+        uint64_t acc = 0;
+        Node* node = root;
+        while (node) {
+            if (less(node->val, elem)) {
+                acc += hash_sum(node->left);
+                if (!is_dead(node)) {
+                    acc += elem_hash(node->val);
+                }
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return acc;
+    }
+
+    // Range endpoints for the diff recursion; null means unbounded
+    uint64_t digest_range(const ValueType* lo, const ValueType* hi) const {
+        uint64_t acc = (hi ? digest_below(*hi) : digest());
+        if (lo) {
+            acc -= digest_below(*lo);
+        }
+        return acc;
+    }
+    size_t count_range(const ValueType* lo, const ValueType* hi) const {
+        size_t acc = (hi ? rank_of(*hi) : sz);
+        if (lo) {
+            acc -= rank_of(*lo);
+        }
+        return acc;
+    }
+    Node* range_begin(const ValueType* lo) const {
+        return (lo ? lb(*lo) : head);
+    }
+
+    template<typename OutputIterator>
+    void emit_range(const ValueType* lo, const ValueType* hi, bool mine,
+                    OutputIterator& out) const {
+        Node* stop = (hi ? lb(*hi) : nullptr);
+        for (Node* node = range_begin(lo); node != stop; node = node->next()) {
+            *out++ = std::pair<ValueType, bool>(node->val, mine);
+        }
+    }
+
+    template<typename OutputIterator>
+    void diff_ranges(const Set& other, const ValueType* lo, const ValueType* hi,
+                     OutputIterator& out) const {
+        if (digest_range(lo, hi) == other.digest_range(lo, hi)) {
+            return;  // same content on both sides: the whole range is skipped
+        }
+        size_t mine_n = count_range(lo, hi);
+        size_t theirs_n = other.count_range(lo, hi);
+        if (mine_n == 0 || theirs_n == 0) {
+            emit_range(lo, hi, true, out);
+            other.emit_range(lo, hi, false, out);
+            return;
+        }
+        if (mine_n == 1 && theirs_n == 1) {
+            const ValueType& a = range_begin(lo)->val;
+            const ValueType& b = other.range_begin(lo)->val;
+            if (cmp(a, b) || cmp(b, a)) {
+                *out++ = std::pair<ValueType, bool>(a, true);
+                *out++ = std::pair<ValueType, bool>(b, false);
+            }
+            return;
+        }
+        // Halve the bigger side by rank and recurse on both key intervals
+        const Set& big = (mine_n >= theirs_n ? *this : other);
+        size_t before = (lo ? big.rank_of(*lo) : 0);
+        size_t half = (mine_n >= theirs_n ? mine_n : theirs_n) / 2;
+        const ValueType& pivot = big.nth(before + half).node->val;
+        diff_ranges(other, lo, &pivot, out);
+        diff_ranges(other, &pivot, hi, out);
+    }
+
+    // How many nodes the scan loop stays ahead of the callback; enough to
+    // cover a memory round trip without thrashing the L1
+    enum { SCAN_PREFETCH = 8 };
+    // Probes descending in lockstep per find_batch round: enough in-flight
+    // misses to fill the memory pipeline without spilling the cursor state
+    enum { BATCH_WIDTH = 16 };
+
+    template<typename F>
+    void scan_nodes(Node* from, Node* to, F& f) const {
+        Node* ahead = from;
+        for (int i = 0; ahead != to && i < SCAN_PREFETCH; ++i) {
+            ahead = ahead->next();
+        }
+        for (Node* node = from; node != to; node = node->next()) {
+            if (ahead != to) {
+                __builtin_prefetch(ahead);
+                ahead = ahead->next();
+            }
+            f(node->val);
+        }
+    }
+
+    void maybe_compact() {
+        if (dead_cnt > sz) {
+            compact();
+        }
+    }
+
+    template<typename K>
+    Node* ub(const K& elem) const {
+        if (dead_cnt) {
+            size_t r = rank_of(elem);
+            if (search(elem)) {
+                r++;
+            }
+            return nth(r).node;
+        }
+        Node* best = nullptr;
+        Node* node = root;
+        while (node) {
+            AVL_STATS_INC(nodes_visited);
+            if (less(elem, node->val)) {
+                best = node;
+                node = node->left;
+            } else {
+                node = node->right;
+            }
+        }
+        return best;
+    }
+
+    // A unique-key set has at most one match, so the pair is the lower bound
+    // plus at most one threading step
+    template<typename K>
+    std::pair<iterator, iterator> eq_range(const K& elem) const {
+        Node* node = lb(elem);
+        if (node && !less(elem, node->val)) {
+            return std::make_pair(iterator(this, node), iterator(this, node->next()));
+        }
+        return std::make_pair(iterator(this, node), iterator(this, node));
+    }
+
+    template<typename K>
+    Node* lb(const K& elem) const {
+        if (dead_cnt) {
+            // with tombstones the candidate-tracking descent can settle on a
+            // dead node, so take the alive element at the alive rank instead
+            return nth(rank_of(elem)).node;
+        }
+        Node* best = nullptr;
+        Node* node = root;
+        while (node) {
+            AVL_STATS_INC(nodes_visited);
+            if (less(node->val, elem)) {
+                node = node->right;
+            } else {
+                best = node;
+                node = node->left;
+            }
+        }
+        return best;
+    }
+};
+
+// Zero-copy view over a serialized Set image, e.g. an mmap'ed snapshot file:
+// lookups binary-search the sorted payload in place, so cold start costs one
+// mmap instead of rebuilding the tree. The view does not own the memory
+template<class ValueType>
+class FlatSetView {
+public:
+    static_assert(std::is_trivially_copyable<ValueType>::value,
+                  "a flat view needs a trivially copyable ValueType");
+
+    using iterator = const ValueType*;
+
+    FlatSetView(): vals(nullptr), n(0), ok(false) {}
+
+    // A malformed or truncated image yields an empty, invalid view
+    FlatSetView(const void* data, size_t bytes): FlatSetView() {
+        if (bytes < HEADER_BYTES) {
+            return;
+        }
+        uint64_t header[3];
+        // the header is memcpy'd out so the buffer itself needs no alignment
+        std::copy_n(static_cast<const unsigned char*>(data), sizeof(header),
+                    reinterpret_cast<unsigned char*>(header));
+        if (header[0] != FLAT_SET_MAGIC || header[1] != sizeof(ValueType)) {
+            return;
+        }
+        // compare in element units: the multiplication the byte form needs
+        // overflows for a corrupt count and would wave the image through
+        if (header[2] > (bytes - HEADER_BYTES) / sizeof(ValueType)) {
+            return;
+        }
+        vals = reinterpret_cast<const ValueType*>(
+            static_cast<const unsigned char*>(data) + HEADER_BYTES);
+        n = header[2];
+        ok = true;
+    }
+
+    bool valid() const {
+        return ok;
+    }
+    size_t size() const {
+        return n;
+    }
+    bool empty() const {
+        return (n == 0);
+    }
+
+    iterator begin() const {
+        return vals;
+    }
+    iterator end() const {
+        return vals + n;
+    }
+
+    iterator lower_bound(const ValueType& elem) const {
+        return std::lower_bound(vals, vals + n, elem);
+    }
+    iterator find(const ValueType& elem) const {
+        iterator it = lower_bound(elem);
+        return (it != end() && !(elem < *it) ? it : end());
+    }
+
+private:
+    enum : size_t { HEADER_BYTES = 24 };
+
+    const ValueType* vals;
+    size_t n;
+    bool ok;
+};
+
+// Set algebra. set_union takes its arguments by value so callers can
+// std::move() inputs they no longer need; it then merges by stealing nodes.
+// Intersection and difference are ordered two-pointer walks over the
+// threading feeding the O(n) sorted loader
+template<class ValueType, class Compare>
+Set<ValueType, Compare> set_union(Set<ValueType, Compare> a, Set<ValueType, Compare> b) {
+    if (a.size() < b.size()) {
+        a.swap(b);
+    }
+    a.merge(std::move(b));
+    return a;
+}
+
+template<class ValueType, class Compare>
+Set<ValueType, Compare> set_intersection(const Set<ValueType, Compare>& a,
+                                         const Set<ValueType, Compare>& b) {
+    Compare cmp = a.key_comp();
+    std::vector<ValueType> common;
+    auto ia = a.begin();
+    auto ib = b.begin();
+    while (ia != a.end() && ib != b.end()) {
+        if (cmp(*ia, *ib)) {
+            ++ia;
+        } else if (cmp(*ib, *ia)) {
+            ++ib;
+        } else {
+            common.push_back(*ia);
+            ++ia;
+            ++ib;
+        }
+    }
+    return Set<ValueType, Compare>::from_sorted(common.begin(), common.end());
+}
+
+template<class ValueType, class Compare>
+Set<ValueType, Compare> set_difference(const Set<ValueType, Compare>& a,
+                                       const Set<ValueType, Compare>& b) {
+    Compare cmp = a.key_comp();
+    std::vector<ValueType> rest;
+    auto ia = a.begin();
+    auto ib = b.begin();
+    while (ia != a.end()) {
+        if (ib == b.end() || cmp(*ia, *ib)) {
+            rest.push_back(*ia);
+            ++ia;
+        } else if (cmp(*ib, *ia)) {
+            ++ib;
+        } else {
+            ++ia;
+            ++ib;
+        }
+    }
+    return Set<ValueType, Compare>::from_sorted(rest.begin(), rest.end());
+}
+
+#endif  // AVL_TREE_H
@@ -0,0 +1,624 @@
+/*
+B-tree Set
+Fat-node alternative to Set (avl_tree.h) with the same public surface:
+insert/erase/find/lower_bound, ordered bidirectional iteration, copy/move.
+Each node keeps up to 15 sorted keys in one contiguous array (minimum degree
+8), so a descent does one cache-line-friendly in-node scan per level instead
+of one pointer chase per key, and the tree is 3-4x shallower than a binary
+tree over the same keys.
+*/
+
+#ifndef AVL_BTREE_SET_H
+#define AVL_BTREE_SET_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+template<class ValueType>
+class BTreeSet {
+private:
+    struct Node;
+
+public:
+    using init_list = std::initializer_list<ValueType>;
+
+    // Position is a (node, slot) pair; stepping within a leaf is an index
+    // bump, crossing a node boundary climbs or descends at most one path
+    class iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = ValueType;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const ValueType*;
+        using reference = const ValueType&;
+
+        iterator(): owner(nullptr), node(nullptr), idx(0) {}
+
+        reference operator * () const {
+            return key(node, idx);
+        }
+        pointer operator -> () const {
+            return &key(node, idx);
+        }
+
+        iterator& operator ++ () {
+            if (!node->leaf) {
+                node = leftmost(node->children[idx + 1]);
+                idx = 0;
+                return *this;
+            }
+            ++idx;
+            while (node && idx == node->n) {
+                Node* child = node;
+                node = node->parent;
+                idx = (node ? child_index(node, child) : 0);
+            }
+            return *this;
+        }
+        iterator operator ++ (int) {
+            iterator old = *this;
+            ++(*this);
+            return old;
+        }
+        iterator& operator -- () {
+            if (!node) {
+                node = rightmost(owner->root);
+                idx = node->n - 1;
+                return *this;
+            }
+            if (!node->leaf) {
+                node = rightmost(node->children[idx]);
+                idx = node->n - 1;
+                return *this;
+            }
+            while (node && idx == 0) {
+                Node* child = node;
+                node = node->parent;
+                idx = (node ? child_index(node, child) : 0);
+            }
+            --idx;
+            return *this;
+        }
+        iterator operator -- (int) {
+            iterator old = *this;
+            --(*this);
+            return old;
+        }
+
+        bool operator == (const iterator& other) const {
+            return node == other.node && idx == other.idx;
+        }
+        bool operator != (const iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class BTreeSet;
+
+        iterator(const BTreeSet* owner, Node* node, int idx): owner(owner), node(node), idx(idx) {}
+
+        const BTreeSet* owner;
+        Node* node;
+        int idx;
+    };
+
+    BTreeSet(): root(nullptr), sz(0) {}
+
+    template<typename Iterator>
+    BTreeSet(Iterator first, Iterator last): BTreeSet() {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    BTreeSet(const init_list& elems): BTreeSet() {
+        for (const auto& elem : elems) {
+            insert(elem);
+        }
+    }
+
+    BTreeSet(const BTreeSet& other): BTreeSet() {
+        root = clone(other.root, nullptr);
+        sz = other.sz;
+    }
+    BTreeSet& operator = (const BTreeSet& other) {
+        if (this != &other) {
+            destroy(root);
+            root = clone(other.root, nullptr);
+            sz = other.sz;
+        }
+
+        return *this;
+    }
+
+    BTreeSet(BTreeSet&& other) noexcept: BTreeSet() {
+        swap(other);
+    }
+    BTreeSet& operator = (BTreeSet&& other) noexcept {
+        if (this != &other) {
+            destroy(root);
+            root = nullptr;
+            sz = 0;
+            swap(other);
+        }
+
+        return *this;
+    }
+
+    ~BTreeSet() {
+        destroy(root);
+    }
+
+    void swap(BTreeSet& other) {
+        std::swap(root, other.root);
+        std::swap(sz, other.sz);
+    }
+
+    size_t size() const {
+        return sz;
+    }
+    bool empty() const {
+        return (sz == 0);
+    }
+
+    void insert(const ValueType& elem) {
+        if (put(elem)) {
+            sz++;
+        }
+    }
+    void erase(const ValueType& elem) {
+        if (root && del(elem)) {
+            sz--;
+        }
+    }
+
+    iterator begin() const {
+        if (!root) {
+            return end();
+        }
+        return iterator(this, leftmost(root), 0);
+    }
+    iterator end() const {
+        return iterator(this, nullptr, 0);
+    }
+
+    iterator find(const ValueType& elem) const {
+        Node* node = root;
+        while (node) {
+            int i = scan(node, elem);
+            if (i < node->n && !(elem < key(node, i))) {
+                return iterator(this, node, i);
+            }
+            node = (node->leaf ? nullptr : node->children[i]);
+        }
+        return end();
+    }
+    iterator lower_bound(const ValueType& elem) const {
+        Node* best_node = nullptr;
+        int best_idx = 0;
+        Node* node = root;
+        while (node) {
+            int i = scan(node, elem);
+            if (i < node->n) {
+                best_node = node;
+                best_idx = i;
+                if (!(elem < key(node, i))) {
+                    break;
+                }
+            }
+            node = (node->leaf ? nullptr : node->children[i]);
+        }
+        return (best_node ? iterator(this, best_node, best_idx) : end());
+    }
+
+private:
+    // Minimum degree 8: nodes hold 7-15 keys (the root may hold fewer) and
+    // internal nodes 8-16 children; 15 8-byte keys fill two cache lines
+    enum { MIN_KEYS = 7, MAX_KEYS = 15, MAX_CHILDREN = 16 };
+
+    struct Node {
+        typename std::aligned_storage<sizeof(ValueType), alignof(ValueType)>::type key_store[MAX_KEYS];
+        Node* children[MAX_CHILDREN];  // meaningful only when !leaf
+        Node* parent;
+        int n;  // number of live keys
+        bool leaf;
+
+        Node(bool is_leaf, Node* par): parent(par), n(0), leaf(is_leaf) {}
+    };
+
+    Node* root;
+    size_t sz;
+
+    static ValueType& key(Node* node, int i) {
+        return reinterpret_cast<ValueType&>(node->key_store[i]);
+    }
+    static void place_key(Node* node, int i, const ValueType& v) {
+        new (&node->key_store[i]) ValueType(v);
+    }
+    static void place_key(Node* node, int i, ValueType&& v) {
+        new (&node->key_store[i]) ValueType(std::move(v));
+    }
+    static void drop_key(Node* node, int i) {
+        key(node, i).~ValueType();
+    }
+    // Keys are relocated by move-construct + destroy, so ValueType only needs
+    // to be copy- or move-constructible, never assignable
+    static void relocate_key(Node* to, int ti, Node* from, int fi) {
+        place_key(to, ti, std::move(key(from, fi)));
+        drop_key(from, fi);
+    }
+
+    static Node* leftmost(Node* node) {
+        while (!node->leaf) {
+            node = node->children[0];
+        }
+        return node;
+    }
+    static Node* rightmost(Node* node) {
+        while (!node->leaf) {
+            node = node->children[node->n];
+        }
+        return node;
+    }
+    static int child_index(Node* parent, Node* child) {
+        int i = 0;
+        while (parent->children[i] != child) {
+            ++i;
+        }
+        return i;
+    }
+
+    // In-node lower bound over the contiguous key array. Arithmetic key
+    // types take a branchless counting path (a sorted array's lower bound
+    // equals the number of keys below the probe), which vectorizes over the
+    // packed key array; everything else keeps the early-exit compare chain,
+    // where each extra comparison may be expensive.
+    static int scan(Node* node, const ValueType& elem) {
+        return scan_impl(node, elem,
+                         std::integral_constant<bool, std::is_arithmetic<ValueType>::value>());
+    }
+
+    static int scan_impl(Node* node, const ValueType& elem, std::false_type) {
+        int i = 0;
+        while (i < node->n && key(node, i) < elem) {
+            ++i;
+        }
+        return i;
+    }
+    static int scan_impl(Node* node, const ValueType& elem, std::true_type) {
+        return ScanKernel<ValueType>::run(&key(node, 0), node->n, elem);
+    }
+
+    // Counting kernels for the arithmetic path. The generic one is a plain
+    // branch-free loop the compiler turns into packed compares on its own;
+    // the specializations below pin down the common integer widths with
+    // explicit SSE when the target has it.
+    template<typename T, typename Enable = void>
+    struct ScanKernel {
+        static int run(const T* keys, int n, T elem) {
+            int cnt = 0;
+            for (int i = 0; i < n; ++i) {
+                cnt += (keys[i] < elem) ? 1 : 0;
+            }
+            return cnt;
+        }
+    };
+
+#if defined(__SSE2__)
+    // 32-bit signed integers: four keys per compare
+    template<typename T>
+    struct ScanKernel<T, typename std::enable_if<std::is_integral<T>::value &&
+                                                 std::is_signed<T>::value &&
+                                                 sizeof(T) == 4>::type> {
+        static int run(const T* keys, int n, T elem) {
+            __m128i pivot = _mm_set1_epi32(elem);
+            int cnt = 0;
+            int i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+                __m128i below = _mm_cmplt_epi32(block, pivot);
+                cnt += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(below)));
+            }
+            for (; i < n; ++i) {
+                cnt += (keys[i] < elem) ? 1 : 0;
+            }
+            return cnt;
+        }
+    };
+#endif
+#if defined(__SSE4_2__)
+    // 64-bit signed integers: the packed 64-bit compare needs SSE4.2
+    template<typename T>
+    struct ScanKernel<T, typename std::enable_if<std::is_integral<T>::value &&
+                                                 std::is_signed<T>::value &&
+                                                 sizeof(T) == 8>::type> {
+        static int run(const T* keys, int n, T elem) {
+            __m128i pivot = _mm_set1_epi64x(elem);
+            int cnt = 0;
+            int i = 0;
+            for (; i + 2 <= n; i += 2) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+                __m128i below = _mm_cmpgt_epi64(pivot, block);
+                cnt += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(below)));
+            }
+            for (; i < n; ++i) {
+                cnt += (keys[i] < elem) ? 1 : 0;
+            }
+            return cnt;
+        }
+    };
+#endif
+
+    // Opens slot i by shifting keys [i, n) one step right; slot must be free
+    template<typename V>
+    static void insert_key_at(Node* node, int i, V&& v) {
+        for (int j = node->n; j > i; --j) {
+            relocate_key(node, j, node, j - 1);
+        }
+        place_key(node, i, std::forward<V>(v));
+        node->n++;
+    }
+    static void remove_key_at(Node* node, int i) {
+        drop_key(node, i);
+        for (int j = i; j + 1 < node->n; ++j) {
+            relocate_key(node, j, node, j + 1);
+        }
+        node->n--;
+    }
+    static void insert_child_at(Node* node, int i, Node* child) {
+        for (int j = node->n; j >= i; --j) {
+            node->children[j + 1] = node->children[j];
+        }
+        node->children[i] = child;
+    }
+    static void remove_child_at(Node* node, int i) {
+        for (int j = i; j < node->n; ++j) {
+            node->children[j] = node->children[j + 1];
+        }
+    }
+
+    // Splits parent's full child i into two half-full nodes around its median
+    // key, which moves up into the parent
+    void split_child(Node* parent, int i) {
+        Node* left = parent->children[i];
+        Node* right = new Node(left->leaf, parent);
+
+        for (int j = 0; j < MIN_KEYS; ++j) {
+            relocate_key(right, j, left, MIN_KEYS + 1 + j);
+        }
+        if (!left->leaf) {
+            for (int j = 0; j <= MIN_KEYS; ++j) {
+                right->children[j] = left->children[MIN_KEYS + 1 + j];
+                right->children[j]->parent = right;
+            }
+        }
+        right->n = MIN_KEYS;
+        left->n = MIN_KEYS;
+
+        insert_child_at(parent, i + 1, right);
+        insert_key_at(parent, i, std::move(key(left, MIN_KEYS)));
+        drop_key(left, MIN_KEYS);
+    }
+
+    // Top-down insert: full nodes are split on the way down so the leaf
+    // always has room; returns false if the key already exists
+    bool put(const ValueType& elem) {
+        if (!root) {
+            root = new Node(true, nullptr);
+            place_key(root, 0, elem);
+            root->n = 1;
+            return true;
+        }
+
+        if (root->n == MAX_KEYS) {
+            Node* new_root = new Node(false, nullptr);
+            new_root->children[0] = root;
+            root->parent = new_root;
+            split_child(new_root, 0);
+            root = new_root;
+        }
+
+        Node* node = root;
+        while (true) {
+            int i = scan(node, elem);
+            if (i < node->n && !(elem < key(node, i))) {
+                return false;
+            }
+            if (node->leaf) {
+                insert_key_at(node, i, elem);
+                return true;
+            }
+
+            Node* child = node->children[i];
+            if (child->n == MAX_KEYS) {
+                split_child(node, i);
+                if (key(node, i) < elem) {
+                    child = node->children[i + 1];
+                } else if (elem < key(node, i)) {
+                    child = node->children[i];
+                } else {
+                    return false;  // the promoted median is the key itself
+                }
+            }
+            node = child;
+        }
+    }
+
+    // Moves a key from sibling i-1 (through the separator) into child i
+    void borrow_left(Node* parent, int i) {
+        Node* child = parent->children[i];
+        Node* left = parent->children[i - 1];
+
+        insert_key_at(child, 0, std::move(key(parent, i - 1)));
+        drop_key(parent, i - 1);
+        place_key(parent, i - 1, std::move(key(left, left->n - 1)));
+        drop_key(left, left->n - 1);
+        if (!child->leaf) {
+            insert_child_at(child, 0, left->children[left->n]);
+            child->children[0]->parent = child;
+            // children[] slot insertion counts against n, which insert_key_at
+            // already bumped, so just drop the donor's slot
+        }
+        left->n--;
+    }
+    // Mirror image: moves a key from sibling i+1 into child i
+    void borrow_right(Node* parent, int i) {
+        Node* child = parent->children[i];
+        Node* right = parent->children[i + 1];
+
+        place_key(child, child->n, std::move(key(parent, i)));
+        child->n++;
+        drop_key(parent, i);
+        place_key(parent, i, std::move(key(right, 0)));
+        if (!child->leaf) {
+            child->children[child->n] = right->children[0];
+            child->children[child->n]->parent = child;
+            remove_child_at(right, 0);
+        }
+        remove_key_at(right, 0);
+    }
+
+    // Folds child i+1 and the separator key into child i and frees it
+    void merge_children(Node* parent, int i) {
+        Node* left = parent->children[i];
+        Node* right = parent->children[i + 1];
+
+        place_key(left, left->n, std::move(key(parent, i)));
+        left->n++;
+        for (int j = 0; j < right->n; ++j) {
+            relocate_key(left, left->n + j, right, j);
+        }
+        if (!left->leaf) {
+            for (int j = 0; j <= right->n; ++j) {
+                left->children[left->n + j] = right->children[j];
+                left->children[left->n + j]->parent = left;
+            }
+        }
+        left->n += right->n;
+        right->n = 0;
+
+        // child removal first: remove_child_at's shift is bounded by the key
+        // count, which remove_key_at is about to decrement
+        remove_child_at(parent, i + 1);
+        remove_key_at(parent, i);
+        delete right;
+    }
+
+    // Guarantees child i of parent has more than MIN_KEYS keys before the
+    // removal descends into it
+    void fill_child(Node* parent, int i) {
+        if (i > 0 && parent->children[i - 1]->n > MIN_KEYS) {
+            borrow_left(parent, i);
+        } else if (i < parent->n && parent->children[i + 1]->n > MIN_KEYS) {
+            borrow_right(parent, i);
+        } else if (i < parent->n) {
+            merge_children(parent, i);
+        } else {
+            merge_children(parent, i - 1);
+        }
+    }
+
+    bool del(const ValueType& elem) {
+        bool erased = remove_from(root, elem);
+        if (root->n == 0) {
+            Node* old_root = root;
+            root = (root->leaf ? nullptr : root->children[0]);
+            if (root) {
+                root->parent = nullptr;
+            }
+            delete old_root;
+        }
+        return erased;
+    }
+
+    // CLRS-style removal: every node entered (except the root) is first
+    // brought above the minimum key count, so no fixups are needed on the
+    // way back up
+    bool remove_from(Node* node, const ValueType& elem) {
+        int i = scan(node, elem);
+        bool found = (i < node->n && !(elem < key(node, i)));
+
+        if (node->leaf) {
+            if (!found) {
+                return false;
+            }
+            remove_key_at(node, i);
+            return true;
+        }
+
+        if (found) {
+            Node* left = node->children[i];
+            Node* right = node->children[i + 1];
+            if (left->n > MIN_KEYS) {
+                // replace with the in-order predecessor, then remove that
+                ValueType pred = key(rightmost(left), rightmost(left)->n - 1);
+                drop_key(node, i);
+                place_key(node, i, pred);
+                return remove_from(left, pred);
+            }
+            if (right->n > MIN_KEYS) {
+                ValueType succ = key(leftmost(right), 0);
+                drop_key(node, i);
+                place_key(node, i, succ);
+                return remove_from(right, succ);
+            }
+            merge_children(node, i);
+            return remove_from(left, elem);
+        }
+
+        Node* child = node->children[i];
+        if (child->n == MIN_KEYS) {
+            fill_child(node, i);
+            // borrowing/merging may have reshuffled this node's keys (the
+            // target could even have rotated up into it), so redo the search
+            return remove_from(node, elem);
+        }
+        return remove_from(child, elem);
+    }
+
+    Node* clone(Node* node, Node* parent) {
+        if (!node) {
+            return nullptr;
+        }
+        Node* copy = new Node(node->leaf, parent);
+        copy->n = node->n;
+        for (int i = 0; i < node->n; ++i) {
+            place_key(copy, i, key(node, i));
+        }
+        if (!node->leaf) {
+            for (int i = 0; i <= node->n; ++i) {
+                copy->children[i] = clone(node->children[i], copy);
+            }
+        }
+        return copy;
+    }
+
+    void destroy(Node* node) {
+        if (!node) {
+            return;
+        }
+        if (!node->leaf) {
+            for (int i = 0; i <= node->n; ++i) {
+                destroy(node->children[i]);
+            }
+        }
+        for (int i = 0; i < node->n; ++i) {
+            drop_key(node, i);
+        }
+        delete node;
+    }
+};
+
+#endif  // AVL_BTREE_SET_H
@@ -0,0 +1,359 @@
+/*
+Concurrent AVL Tree
+Single-writer / multi-reader companion of Set (avl_tree.h).
+
+Readers (contains/lower_bound/for_each) are wait-free: they pin the current
+epoch, load the root once and descend a tree whose nodes are never mutated
+after publication. Root accesses are seq_cst so a reader that pinned epoch E
+cannot observe a root predating the retirements epoch E already allows to be
+freed. The writer updates by path copying - insert/erase allocate
+fresh copies of the root-to-leaf path, publish the new root with one atomic
+store, and retire the replaced nodes. Retired nodes are reclaimed in batches
+once every pinned reader epoch has moved past the retirement epoch, so a
+reader can keep dereferencing whatever it reached. insert/erase themselves
+must be called from one thread at a time; that is the intended deployment
+(one ingest thread, many query threads).
+*/
+
+#ifndef AVL_CONCURRENT_SET_H
+#define AVL_CONCURRENT_SET_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+template<class ValueType>
+class ConcurrentSet {
+public:
+    ConcurrentSet(): root(nullptr), sz(0), epoch(1) {
+        for (auto& slot : reader_epochs) {
+            slot.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ConcurrentSet(const ConcurrentSet&) = delete;
+    ConcurrentSet& operator = (const ConcurrentSet&) = delete;
+
+    ~ConcurrentSet() {
+        destroy(root.load(std::memory_order_relaxed));
+        for (auto& dead : limbo) {
+            delete dead.first;
+        }
+    }
+
+    size_t size() const {
+        return sz.load(std::memory_order_relaxed);
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // ---- writer side (one mutating thread at a time) ----
+
+    void insert(const ValueType& elem) {
+        bool inserted = false;
+        Node* fresh = put(root.load(std::memory_order_relaxed), elem, inserted);
+        if (inserted) {
+            root.store(fresh, std::memory_order_seq_cst);
+            sz.fetch_add(1, std::memory_order_relaxed);
+            maybe_reclaim();
+        }
+    }
+
+    void erase(const ValueType& elem) {
+        bool erased = false;
+        Node* fresh = del(root.load(std::memory_order_relaxed), elem, erased);
+        if (erased) {
+            root.store(fresh, std::memory_order_seq_cst);
+            sz.fetch_sub(1, std::memory_order_relaxed);
+            maybe_reclaim();
+        }
+    }
+
+    // ---- reader side (any thread, wait-free) ----
+
+    bool contains(const ValueType& elem) const {
+        Guard guard(this);
+        const Node* node = root.load(std::memory_order_seq_cst);
+        while (node) {
+            if (elem < node->val) {
+                node = node->left;
+            } else if (node->val < elem) {
+                node = node->right;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Copies the first element not less than elem into out; returns false if
+    // there is none. Copying is what lets the reference escape the epoch
+    bool lower_bound(const ValueType& elem, ValueType& out) const {
+        Guard guard(this);
+        const Node* best = nullptr;
+        const Node* node = root.load(std::memory_order_seq_cst);
+        while (node) {
+            if (node->val < elem) {
+                node = node->right;
+            } else {
+                best = node;
+                node = node->left;
+            }
+        }
+        if (!best) {
+            return false;
+        }
+        out = best->val;
+        return true;
+    }
+
+    // In-order visit of a consistent snapshot of the set
+    template<typename F>
+    void for_each(F func) const {
+        Guard guard(this);
+        visit(root.load(std::memory_order_seq_cst), func);
+    }
+
+private:
+    struct Node {
+        const ValueType val;
+        Node* left, *right;  // immutable once the node is published
+        int h;
+
+        Node(const ValueType& v, Node* l, Node* r, int height): val(v), left(l), right(r), h(height) {}
+    };
+
+    enum { MAX_READERS = 64 };
+    enum { RECLAIM_EVERY = 128 };  // writes between reclamation sweeps
+
+    // Pins one reader slot to the current epoch for the guard's lifetime;
+    // the writer never frees a node retired in an epoch a pinned reader
+    // might still be traversing
+    class Guard {
+    public:
+        explicit Guard(const ConcurrentSet* owner): owner(owner), slot(nullptr) {
+            for (auto& candidate : owner->reader_epochs) {
+                uint64_t expected = 0;
+                if (candidate.compare_exchange_strong(expected,
+                        owner->epoch.load(std::memory_order_seq_cst),
+                        std::memory_order_seq_cst)) {
+                    slot = &candidate;
+                    return;
+                }
+            }
+            // More simultaneous readers than slots: fall back to spinning on
+            // slot release so correctness never depends on the slot count
+            while (!slot) {
+                for (auto& candidate : owner->reader_epochs) {
+                    uint64_t expected = 0;
+                    if (candidate.compare_exchange_strong(expected,
+                            owner->epoch.load(std::memory_order_seq_cst),
+                            std::memory_order_seq_cst)) {
+                        slot = &candidate;
+                        break;
+                    }
+                }
+            }
+        }
+        ~Guard() {
+            slot->store(0, std::memory_order_release);
+        }
+
+    private:
+        const ConcurrentSet* owner;
+        std::atomic<uint64_t>* slot;
+    };
+    friend class Guard;
+
+    std::atomic<Node*> root;
+    std::atomic<size_t> sz;
+    std::atomic<uint64_t> epoch;
+    mutable std::atomic<uint64_t> reader_epochs[MAX_READERS];
+    std::vector<std::pair<Node*, uint64_t>> limbo;  // writer-only: (node, retire epoch)
+    size_t writes_since_reclaim = 0;
+
+    static int height(const Node* node) {
+        return (node ? node->h : 0);
+    }
+    static int diff(const Node* node) {
+        return height(node->right) - height(node->left);
+    }
+
+    Node* make(const ValueType& v, Node* l, Node* r) {
+        return new Node(v, l, r, 1 + std::max(height(l), height(r)));
+    }
+
+    void retire(Node* node) {
+        limbo.emplace_back(node, epoch.load(std::memory_order_relaxed));
+    }
+
+    void maybe_reclaim() {
+        if (++writes_since_reclaim < RECLAIM_EVERY) {
+            return;
+        }
+        writes_since_reclaim = 0;
+
+        uint64_t closed = epoch.fetch_add(1, std::memory_order_seq_cst);
+        uint64_t min_pinned = closed + 1;
+        for (const auto& slot : reader_epochs) {
+            uint64_t pinned = slot.load(std::memory_order_seq_cst);
+            if (pinned != 0 && pinned < min_pinned) {
+                min_pinned = pinned;
+            }
+        }
+
+        size_t kept = 0;
+        for (auto& dead : limbo) {
+            if (dead.second < min_pinned) {
+                delete dead.first;
+            } else {
+                limbo[kept++] = dead;
+            }
+        }
+        limbo.resize(kept);
+    }
+
+    // relax only ever runs on nodes created during the current operation;
+    // published nodes stay immutable
+    Node* relax(Node* node) {
+        node->h = 1 + std::max(height(node->left), height(node->right));
+        return node;
+    }
+    // Rotations rebuild the pivot as a fresh node instead of rewriting its
+    // child pointers: on erase the child being raised is the subtree the
+    // descent did not copy, so it can still be reachable from the old root
+    // with readers inside it. node itself is always this operation's copy
+    Node* rotate_left(Node* node) {
+        Node* center = node->right;
+        node->right = center->left;
+        relax(node);
+        retire(center);
+        return make(center->val, node, center->right);
+    }
+    Node* rotate_right(Node* node) {
+        Node* center = node->left;
+        node->left = center->right;
+        relax(node);
+        retire(center);
+        return make(center->val, center->left, node);
+    }
+    // Fresh copy of a possibly shared node, so a rotation may write to it
+    Node* unshare(Node* node) {
+        Node* copy = make(node->val, node->left, node->right);
+        retire(node);
+        return copy;
+    }
+    Node* balance(Node* node) {
+        relax(node);
+        int node_balance = diff(node);
+        if (node_balance == 2) {
+            if (diff(node->right) < 0) {
+                node->right = rotate_right(unshare(node->right));
+            }
+            return rotate_left(node);
+        } else if (node_balance == -2) {
+            if (diff(node->left) > 0) {
+                node->left = rotate_left(unshare(node->left));
+            }
+            return rotate_right(node);
+        }
+        return node;
+    }
+
+    Node* put(Node* node, const ValueType& elem, bool& inserted) {
+        if (!node) {
+            inserted = true;
+            return make(elem, nullptr, nullptr);
+        }
+
+        Node* copy;
+        if (elem < node->val) {
+            Node* left = put(node->left, elem, inserted);
+            if (!inserted) {
+                return node;
+            }
+            copy = make(node->val, left, node->right);
+        } else if (node->val < elem) {
+            Node* right = put(node->right, elem, inserted);
+            if (!inserted) {
+                return node;
+            }
+            copy = make(node->val, node->left, right);
+        } else {
+            return node;
+        }
+
+        retire(node);
+        return balance(copy);
+    }
+
+    // Detaches the minimum of a subtree by path copying; out gets the minimum
+    // node's value holder (a fresh copy is not needed, the value is reused)
+    Node* take_min(Node* node, const Node*& out) {
+        if (!node->left) {
+            out = node;
+            return node->right;
+        }
+        Node* copy = make(node->val, take_min(node->left, out), node->right);
+        retire(node);
+        return balance(copy);
+    }
+
+    Node* del(Node* node, const ValueType& elem, bool& erased) {
+        if (!node) {
+            return nullptr;
+        }
+
+        Node* copy;
+        if (elem < node->val) {
+            Node* left = del(node->left, elem, erased);
+            if (!erased) {
+                return node;
+            }
+            copy = make(node->val, left, node->right);
+        } else if (node->val < elem) {
+            Node* right = del(node->right, elem, erased);
+            if (!erased) {
+                return node;
+            }
+            copy = make(node->val, node->left, right);
+        } else {
+            erased = true;
+            if (!node->right) {
+                retire(node);
+                return node->left;
+            }
+            const Node* mn = nullptr;
+            Node* right = take_min(node->right, mn);
+            copy = make(mn->val, node->left, right);
+            retire(const_cast<Node*>(mn));
+        }
+
+        retire(node);
+        return balance(copy);
+    }
+
+    template<typename F>
+    void visit(const Node* node, F& func) const {
+        if (!node) {
+            return;
+        }
+        visit(node->left, func);
+        func(node->val);
+        visit(node->right, func);
+    }
+
+    void destroy(Node* node) {
+        if (!node) {
+            return;
+        }
+        destroy(node->left);
+        destroy(node->right);
+        delete node;
+    }
+};
+
+#endif  // AVL_CONCURRENT_SET_H
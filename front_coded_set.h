@@ -0,0 +1,255 @@
+/*
+Front-Coded Set
+Compressed immutable ordered set for string and integer keys.
+
+Keys are stored in blocks of 16: the block head is written in full and
+every following key only as what it adds — for strings the length of the
+prefix shared with its predecessor plus the fresh suffix, for integers a
+varint-coded delta. URL-style keysets with long shared prefixes shrink
+severalfold; the price is immutability, so the intended use is freezing a
+big read-mostly keyset out of a live Set (or any sorted range) and
+querying the frozen copy.
+
+Lookups binary-search the block heads — decoding one head costs a couple
+of varint reads — and then decode the one chosen block sequentially,
+reconstructing each key from its predecessor as the scan walks; nothing
+is ever decompressed wholesale. rank/nth work the same way off the block
+boundaries, which sit at known multiples of the block size.
+
+Only std::string and built-in integers have an encoding; other value
+types fail to compile at the codec.
+*/
+
+#ifndef AVL_FRONT_CODED_SET_H
+#define AVL_FRONT_CODED_SET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "avl_tree.h"
+
+template<class ValueType, class Compare = std::less<ValueType>>
+class FrontCodedSet {
+public:
+    FrontCodedSet(): sz(0), cmp() {}
+
+    // Builds from a strictly ascending range in one encoding pass
+    template<typename Iterator>
+    static FrontCodedSet from_sorted(Iterator first, Iterator last) {
+        FrontCodedSet result;
+        ValueType prev = ValueType();
+        for (Iterator it = first; it != last; ++it, ++result.sz) {
+            if (result.sz % BLOCK == 0) {
+                result.starts.push_back(result.bytes.size());
+                Codec<ValueType>::encode_head(result.bytes, *it);
+            } else {
+                Codec<ValueType>::encode_next(result.bytes, prev, *it);
+            }
+            prev = *it;
+        }
+        return result;
+    }
+
+    // Freezes a live set; its threading hands the keys over already sorted
+    static FrontCodedSet freeze(const Set<ValueType, Compare>& source) {
+        return from_sorted(source.begin(), source.end());
+    }
+
+    size_t size() const {
+        return sz;
+    }
+    bool empty() const {
+        return (sz == 0);
+    }
+    // Compressed footprint, for sizing against the uncompressed keyset
+    size_t bytes_used() const {
+        return bytes.size() + starts.size() * sizeof(size_t);
+    }
+
+    bool contains(const ValueType& elem) const {
+        ValueType found;
+        return lower_bound(elem, found) && !cmp(elem, found);
+    }
+
+    // Smallest element not less than elem, copied into out (keys are
+    // materialized by decoding, so there is nothing stable to point at)
+    bool lower_bound(const ValueType& elem, ValueType& out) const {
+        return (locate(elem, &out) < sz);
+    }
+
+    // Number of elements less than elem
+    size_t rank(const ValueType& elem) const {
+        return locate(elem, nullptr);
+    }
+
+    // index-th smallest element decoded into out; false when out of range
+    bool nth(size_t index, ValueType& out) const {
+        if (index >= sz) {
+            return false;
+        }
+        const unsigned char* p = &bytes[starts[index / BLOCK]];
+        Codec<ValueType>::decode_head(p, out);
+        for (size_t i = index % BLOCK; i > 0; i--) {
+            Codec<ValueType>::decode_next(p, out);
+        }
+        return true;
+    }
+
+    // In-order visit: one sequential decoding sweep over the byte stream
+    template<typename F>
+    void for_each(F f) const {
+        ValueType cur;
+        const unsigned char* p = bytes.data();
+        for (size_t i = 0; i < sz; i++) {
+            if (i % BLOCK == 0) {
+                Codec<ValueType>::decode_head(p, cur);
+            } else {
+                Codec<ValueType>::decode_next(p, cur);
+            }
+            f(cur);
+        }
+    }
+
+private:
+    enum { BLOCK = 16 };
+
+    // Unsigned LEB128; deltas ride in one or two bytes on dense keysets
+    static void put_uvarint(std::vector<unsigned char>& out, uint64_t x) {
+        while (x >= 0x80) {
+            out.push_back((unsigned char)(x) | 0x80);
+            x >>= 7;
+        }
+        out.push_back((unsigned char)(x));
+    }
+    static uint64_t get_uvarint(const unsigned char*& p) {
+        uint64_t x = 0;
+        int shift = 0;
+        while (*p & 0x80) {
+            x |= uint64_t(*p++ & 0x7f) << shift;
+            shift += 7;
+        }
+        return x | (uint64_t(*p++) << shift);
+    }
+
+    // Per-type encoding; only strings and built-in integers are supported
+    template<typename T, typename Enable = void>
+    struct Codec;
+
+    // Integers: block heads zigzagged (negatives stay short), followers as
+    // the raw difference mod 2^64, which wrap-around addition undoes — no
+    // sign handling and no assumption that the comparator orders numerically
+    template<typename T>
+    struct Codec<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+        static void encode_head(std::vector<unsigned char>& out, const T& v) {
+            uint64_t x = uint64_t(int64_t(v));
+            put_uvarint(out, (x << 1) ^ (uint64_t(0) - (x >> 63)));
+        }
+        static void encode_next(std::vector<unsigned char>& out, const T& prev, const T& v) {
+            put_uvarint(out, uint64_t(v) - uint64_t(prev));
+        }
+        static void decode_head(const unsigned char*& p, T& v) {
+            uint64_t x = get_uvarint(p);
+            v = T(int64_t((x >> 1) ^ (uint64_t(0) - (x & 1))));
+        }
+        static void decode_next(const unsigned char*& p, T& v) {
+            v = T(uint64_t(v) + get_uvarint(p));
+        }
+    };
+
+    // Strings: shared-prefix length against the predecessor plus the fresh
+    // suffix. Decoding mutates the predecessor in place — truncate to the
+    // shared part, append the suffix — so a block scan never reallocates
+    // beyond what the keys themselves require
+    template<typename T>
+    struct Codec<T, typename std::enable_if<std::is_same<T, std::string>::value>::type> {
+        static void encode_head(std::vector<unsigned char>& out, const T& v) {
+            put_uvarint(out, v.size());
+            out.insert(out.end(), v.begin(), v.end());
+        }
+        static void encode_next(std::vector<unsigned char>& out, const T& prev, const T& v) {
+            size_t shared = 0;
+            size_t limit = (prev.size() < v.size() ? prev.size() : v.size());
+            while (shared < limit && prev[shared] == v[shared]) {
+                shared++;
+            }
+            put_uvarint(out, shared);
+            put_uvarint(out, v.size() - shared);
+            out.insert(out.end(), v.begin() + shared, v.end());
+        }
+        static void decode_head(const unsigned char*& p, T& v) {
+            size_t len = (size_t)get_uvarint(p);
+            v.assign(reinterpret_cast<const char*>(p), len);
+            p += len;
+        }
+        static void decode_next(const unsigned char*& p, T& v) {
+            size_t shared = (size_t)get_uvarint(p);
+            size_t suffix = (size_t)get_uvarint(p);
+            v.resize(shared);
+            v.append(reinterpret_cast<const char*>(p), suffix);
+            p += suffix;
+        }
+    };
+
+    ValueType block_head(size_t block) const {
+        ValueType v;
+        const unsigned char* p = &bytes[starts[block]];
+        Codec<ValueType>::decode_head(p, v);
+        return v;
+    }
+
+    // Index of the first element not less than elem (sz when none), decoding
+    // it into out when asked: binary search over the block heads, then one
+    // sequential scan of the chosen block
+    size_t locate(const ValueType& elem, ValueType* out) const {
+        if (sz == 0) {
+            return 0;
+        }
+        // last block whose head is less than elem; the answer cannot sit
+        // before it, and heads from the next block on are all candidates
+        size_t lo = 0;
+        size_t hi = starts.size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (cmp(block_head(mid), elem)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == 0) {
+            if (out) {
+                *out = block_head(0);
+            }
+            return 0;
+        }
+
+        size_t block = lo - 1;
+        size_t index = block * BLOCK;
+        size_t block_end = (index + BLOCK < sz ? index + BLOCK : sz);
+        ValueType cur;
+        const unsigned char* p = &bytes[starts[block]];
+        Codec<ValueType>::decode_head(p, cur);
+        while (cmp(cur, elem)) {
+            if (++index == block_end) {
+                break;
+            }
+            Codec<ValueType>::decode_next(p, cur);
+        }
+        if (index < sz && out) {
+            *out = (index == block * BLOCK + BLOCK ? block_head(block + 1)
+                                                   : cur);
+        }
+        return index;
+    }
+
+    std::vector<unsigned char> bytes;
+    std::vector<size_t> starts;  // byte offset of each block head
+    size_t sz;
+    Compare cmp;
+};
+
+#endif  // AVL_FRONT_CODED_SET_H
@@ -0,0 +1,322 @@
+/*
+Persistent Set
+Path-copying ordered set with O(1) snapshots.
+
+snapshot() returns an independent handle in constant time: both versions
+share the whole tree and every later insert/erase copies only the
+root-to-leaf path it touches (O(log n) fresh nodes), leaving everything
+off the path shared. Sharing is reference-counted per node; a version
+that is the sole owner of a node mutates it in place, so a set nobody has
+snapshotted recently pays close to ordinary tree costs.
+
+This is a separate engine rather than a mode of Set (avl_tree.h): Set
+threads every node into an intrusive prev/next list and recycles storage
+through per-tree arenas, and neither survives nodes being shared between
+versions. PersistentSet drops the threading and keeps subtree counts
+instead, so ordered access is rank/nth/for_each rather than iterators.
+
+Reference counts are atomic: snapshots may be handed to reader threads
+while the writer keeps mutating its own version. Distinct versions are
+safe to use from distinct threads; one version is single-threaded, like
+Set.
+*/
+
+#ifndef AVL_PERSISTENT_SET_H
+#define AVL_PERSISTENT_SET_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+template<class ValueType, class Compare = std::less<ValueType>>
+class PersistentSet {
+public:
+    PersistentSet(): root(nullptr), sz(0), cmp() {}
+    explicit PersistentSet(const Compare& compare): root(nullptr), sz(0), cmp(compare) {}
+
+    // O(1): shares the whole tree with other
+    PersistentSet(const PersistentSet& other)
+        : root(other.root), sz(other.sz), cmp(other.cmp) {
+        retain(root);
+    }
+    PersistentSet(PersistentSet&& other)
+        : root(other.root), sz(other.sz), cmp(other.cmp) {
+        other.root = nullptr;
+        other.sz = 0;
+    }
+    PersistentSet& operator = (PersistentSet other) {
+        swap(other);
+        return *this;
+    }
+
+    ~PersistentSet() {
+        release(root);
+    }
+
+    // Point-in-time view; the copy constructor already has snapshot
+    // semantics, this name just states the intent at call sites
+    PersistentSet snapshot() const {
+        return *this;
+    }
+
+    void swap(PersistentSet& other) {
+        std::swap(root, other.root);
+        std::swap(sz, other.sz);
+        std::swap(cmp, other.cmp);
+    }
+
+    size_t size() const {
+        return sz;
+    }
+    bool empty() const {
+        return (sz == 0);
+    }
+
+    void insert(const ValueType& elem) {
+        if (!contains(elem)) {
+            root = put(root, elem);
+            sz++;
+        }
+    }
+    void erase(const ValueType& elem) {
+        if (contains(elem)) {
+            root = del(root, elem);
+            sz--;
+        }
+    }
+
+    bool contains(const ValueType& elem) const {
+        Node* node = root;
+        while (node) {
+            if (cmp(elem, node->val)) {
+                node = node->left;
+            } else if (cmp(node->val, elem)) {
+                node = node->right;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Smallest element not less than elem, or null. Pointers stay valid as
+    // long as some version still holds the node
+    const ValueType* lower_bound(const ValueType& elem) const {
+        Node* node = root;
+        const ValueType* best = nullptr;
+        while (node) {
+            if (cmp(node->val, elem)) {
+                node = node->right;
+            } else {
+                best = &node->val;
+                node = node->left;
+            }
+        }
+        return best;
+    }
+
+    // Number of elements less than elem
+    size_t rank(const ValueType& elem) const {
+        Node* node = root;
+        size_t before = 0;
+        while (node) {
+            if (cmp(node->val, elem)) {
+                before += weight(node->left) + 1;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return before;
+    }
+
+    // index-th smallest element, or null when out of range
+    const ValueType* nth(size_t index) const {
+        if (index >= sz) {
+            return nullptr;
+        }
+        Node* node = root;
+        while (true) {
+            size_t before = weight(node->left);
+            if (index < before) {
+                node = node->left;
+            } else if (index == before) {
+                return &node->val;
+            } else {
+                index -= before + 1;
+                node = node->right;
+            }
+        }
+    }
+
+    // In-order visit of the whole version
+    template<typename F>
+    void for_each(F f) const {
+        visit(root, f);
+    }
+
+private:
+    struct Node {
+        ValueType val;
+        Node* left;
+        Node* right;
+        int h;
+        size_t cnt;
+        std::atomic<size_t> refs;
+
+        explicit Node(const ValueType& elem)
+            : val(elem), left(nullptr), right(nullptr), h(1), cnt(1), refs(1) {}
+        Node(const Node& other)
+            : val(other.val), left(other.left), right(other.right),
+              h(other.h), cnt(other.cnt), refs(1) {}
+    };
+
+    static void retain(Node* node) {
+        if (node) {
+            node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    static void release(Node* node) {
+        if (node && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release(node->left);
+            release(node->right);
+            delete node;
+        }
+    }
+
+    // Hands back a version of node this tree owns exclusively, consuming the
+    // caller's reference: in place when unshared, otherwise a shallow copy
+    // that re-shares both children. Every mutation passes through here, which
+    // is what bounds copying to the touched path
+    static Node* own(Node* node) {
+        if (node->refs.load(std::memory_order_acquire) == 1) {
+            return node;
+        }
+        Node* copy = new Node(*node);
+        retain(copy->left);
+        retain(copy->right);
+        release(node);
+        return copy;
+    }
+
+    static int height(Node* node) {
+        return node ? node->h : 0;
+    }
+    static size_t weight(Node* node) {
+        return node ? node->cnt : 0;
+    }
+    static void fix(Node* node) {
+        node->h = 1 + std::max(height(node->left), height(node->right));
+        node->cnt = 1 + weight(node->left) + weight(node->right);
+    }
+
+    // Rotations own every node they restructure; on an unshared path they
+    // degenerate to ordinary pointer swaps
+    static Node* rotate_left(Node* node) {
+        node = own(node);
+        Node* pivot = own(node->right);
+        node->right = pivot->left;
+        pivot->left = node;
+        fix(node);
+        fix(pivot);
+        return pivot;
+    }
+    static Node* rotate_right(Node* node) {
+        node = own(node);
+        Node* pivot = own(node->left);
+        node->left = pivot->right;
+        pivot->right = node;
+        fix(node);
+        fix(pivot);
+        return pivot;
+    }
+
+    // node must already be owned
+    static Node* balance(Node* node) {
+        fix(node);
+        int diff = height(node->left) - height(node->right);
+        if (diff > 1) {
+            if (height(node->left->left) < height(node->left->right)) {
+                node->left = rotate_left(node->left);
+            }
+            return rotate_right(node);
+        }
+        if (diff < -1) {
+            if (height(node->right->right) < height(node->right->left)) {
+                node->right = rotate_right(node->right);
+            }
+            return rotate_left(node);
+        }
+        return node;
+    }
+
+    // Insert of a known-absent element; consumes the reference to node
+    Node* put(Node* node, const ValueType& elem) {
+        if (!node) {
+            return new Node(elem);
+        }
+        node = own(node);
+        if (cmp(elem, node->val)) {
+            node->left = put(node->left, elem);
+        } else {
+            node->right = put(node->right, elem);
+        }
+        return balance(node);
+    }
+
+    // Erase of a known-present element; consumes the reference to node
+    Node* del(Node* node, const ValueType& elem) {
+        node = own(node);
+        if (cmp(elem, node->val)) {
+            node->left = del(node->left, elem);
+        } else if (cmp(node->val, elem)) {
+            node->right = del(node->right, elem);
+        } else {
+            if (!node->left || !node->right) {
+                Node* child = node->left ? node->left : node->right;
+                node->left = node->right = nullptr;
+                release(node);
+                return child;
+            }
+            // Two children: splice the successor into node's place
+            Node* mn = nullptr;
+            Node* rest = detach_min(node->right, mn);
+            mn->left = node->left;
+            mn->right = rest;
+            node->left = node->right = nullptr;
+            release(node);
+            node = mn;
+        }
+        return balance(node);
+    }
+
+    // Unlinks the minimum into mn (owned) and returns the remaining subtree
+    static Node* detach_min(Node* node, Node*& mn) {
+        node = own(node);
+        if (!node->left) {
+            mn = node;
+            Node* rest = node->right;
+            node->right = nullptr;
+            return rest;
+        }
+        node->left = detach_min(node->left, mn);
+        return balance(node);
+    }
+
+    template<typename F>
+    static void visit(Node* node, F& f) {
+        if (node) {
+            visit(node->left, f);
+            f(node->val);
+            visit(node->right, f);
+        }
+    }
+
+    Node* root;
+    size_t sz;
+    Compare cmp;
+};
+
+#endif  // AVL_PERSISTENT_SET_H
@@ -0,0 +1,136 @@
+/*
+Sharded Set
+Multi-writer front-end over Set (avl_tree.h).
+
+The keyspace is hash-partitioned across a fixed number of independently
+locked shards, so writers touching different shards never contend; with
+enough shards relative to threads, throughput scales close to linearly
+until the memory bus saturates. Each shard is one ordinary Set under one
+mutex, cache-line aligned so neighbouring locks don't false-share.
+
+Point operations (insert/erase/find) lock exactly one shard. Global order
+still exists — every shard is sorted — so lower_bound takes the minimum of
+the per-shard lower bounds, and for_each_ordered locks all shards and
+k-way merges their threadings. Those two serialize against all writers,
+which is the price of ordered answers over a hash partition; point ops are
+the hot path this class exists for.
+
+ValueType needs a std::hash specialization (or pass a custom Hash).
+*/
+
+#ifndef AVL_SHARDED_SET_H
+#define AVL_SHARDED_SET_H
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+#include "avl_tree.h"
+
+template<class ValueType, size_t Shards = 16,
+         class Compare = std::less<ValueType>, class Hash = std::hash<ValueType>>
+class ShardedSet {
+public:
+    static_assert(Shards >= 1, "a sharded set needs at least one shard");
+
+    ShardedSet(): hasher() {}
+
+    ShardedSet(const ShardedSet&) = delete;
+    ShardedSet& operator = (const ShardedSet&) = delete;
+
+    // Sums live shard sizes; exact only once writers are quiescent, like any
+    // aggregate over a concurrently mutated container
+    size_t size() const {
+        size_t total = 0;
+        for (const Shard& shard : shards) {
+            std::lock_guard<std::mutex> hold(shard.mu);
+            total += shard.set.size();
+        }
+        return total;
+    }
+    bool empty() const {
+        return (size() == 0);
+    }
+
+    void insert(const ValueType& elem) {
+        Shard& shard = shard_of(elem);
+        std::lock_guard<std::mutex> hold(shard.mu);
+        shard.set.insert(elem);
+    }
+    void insert(ValueType&& elem) {
+        Shard& shard = shard_of(elem);
+        std::lock_guard<std::mutex> hold(shard.mu);
+        shard.set.insert(std::move(elem));
+    }
+    void erase(const ValueType& elem) {
+        Shard& shard = shard_of(elem);
+        std::lock_guard<std::mutex> hold(shard.mu);
+        shard.set.erase(elem);
+    }
+    // Iterators cannot outlive the shard lock, so lookups report by value
+    bool find(const ValueType& elem) const {
+        Shard& shard = shard_of(elem);
+        std::lock_guard<std::mutex> hold(shard.mu);
+        return shard.set.find(elem) != shard.set.end();
+    }
+
+    // Smallest element not less than elem across all shards, copied into out;
+    // false when no shard has one. Locks shards one at a time
+    bool lower_bound(const ValueType& elem, ValueType& out) const {
+        bool found = false;
+        for (const Shard& shard : shards) {
+            std::lock_guard<std::mutex> hold(shard.mu);
+            auto it = shard.set.lower_bound(elem);
+            if (it != shard.set.end() && (!found || cmp(*it, out))) {
+                out = *it;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // Globally ordered visit: locks every shard (in index order, so
+    // concurrent callers cannot deadlock) and k-way merges the shard
+    // threadings, scanning the Shards fronts once per emitted element
+    template<typename F>
+    void for_each_ordered(F f) const {
+        std::unique_lock<std::mutex> holds[Shards];
+        typename Set<ValueType, Compare>::iterator cur[Shards];
+        typename Set<ValueType, Compare>::iterator last[Shards];
+        for (size_t i = 0; i < Shards; ++i) {
+            holds[i] = std::unique_lock<std::mutex>(shards[i].mu);
+            cur[i] = shards[i].set.begin();
+            last[i] = shards[i].set.end();
+        }
+
+        while (true) {
+            size_t best = Shards;
+            for (size_t i = 0; i < Shards; ++i) {
+                if (cur[i] != last[i] && (best == Shards || cmp(*cur[i], *cur[best]))) {
+                    best = i;
+                }
+            }
+            if (best == Shards) {
+                break;
+            }
+            f(*cur[best]);
+            ++cur[best];
+        }
+    }
+
+private:
+    struct alignas(64) Shard {
+        mutable std::mutex mu;
+        Set<ValueType, Compare> set;
+    };
+
+    Shard& shard_of(const ValueType& elem) const {
+        return const_cast<Shard&>(shards[hasher(elem) % Shards]);
+    }
+
+    mutable Shard shards[Shards];
+    Hash hasher;
+    Compare cmp;
+};
+
+#endif  // AVL_SHARDED_SET_H
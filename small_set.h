@@ -0,0 +1,276 @@
+/*
+Small Set
+Inline small-buffer front-end over Set (avl_tree.h).
+
+Deployments that hold millions of tiny sets (a handful of elements each)
+pay the tree's fixed overhead — arena blocks, root bookkeeping — per
+instance, and chase pointers for lookups an array would answer from one
+cache line. SmallSet keeps up to N values in a sorted inline array inside
+the object itself: no allocation at all, lookups are a binary search over
+contiguous memory, inserts and erases shift a few elements. The first
+insert past N spills everything into a heap-allocated Set and all later
+operations forward to it; a spilled set never shrinks back, so iterators
+and element addresses in tree mode behave exactly like Set's.
+
+N should stay small (the default 16 keeps the shifts cheaper than a
+descent); past that point the tree wins anyway.
+*/
+
+#ifndef AVL_SMALL_SET_H
+#define AVL_SMALL_SET_H
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <utility>
+
+#include "avl_tree.h"
+
+template<class ValueType, size_t N = 16, class Compare = std::less<ValueType>>
+class SmallSet {
+private:
+    using Tree = Set<ValueType, Compare>;
+
+public:
+    // Points either into the inline array or at a tree node; comparing
+    // iterators from different modes (pre- vs post-spill) is undefined,
+    // same as mixing iterators of two different Sets
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = ValueType;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const ValueType*;
+        using reference = const ValueType&;
+
+        iterator(): ptr(nullptr), in_tree(false) {}
+
+        const ValueType& operator * () const {
+            return in_tree ? *it : *ptr;
+        }
+        const ValueType* operator -> () const {
+            return in_tree ? &*it : ptr;
+        }
+
+        iterator& operator ++ () {
+            if (in_tree) {
+                ++it;
+            } else {
+                ++ptr;
+            }
+            return *this;
+        }
+        iterator operator ++ (int) {
+            iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator == (const iterator& other) const {
+            return in_tree ? (it == other.it) : (ptr == other.ptr);
+        }
+        bool operator != (const iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class SmallSet;
+
+        explicit iterator(const ValueType* p): ptr(p), in_tree(false) {}
+        explicit iterator(typename Tree::iterator i)
+            : ptr(nullptr), it(i), in_tree(true) {}
+
+        const ValueType* ptr;
+        typename Tree::iterator it;
+        bool in_tree;
+    };
+
+    SmallSet(): n(0), tree(nullptr), cmp() {}
+
+    SmallSet(const SmallSet& other): n(0), tree(nullptr), cmp(other.cmp) {
+        if (other.tree) {
+            tree = new Tree(*other.tree);
+        } else {
+            for (; n < other.n; n++) {
+                new (vals() + n) ValueType(other.vals()[n]);
+            }
+        }
+    }
+    SmallSet(SmallSet&& other): n(0), tree(other.tree), cmp(other.cmp) {
+        if (!tree) {
+            for (; n < other.n; n++) {
+                new (vals() + n) ValueType(std::move(other.vals()[n]));
+            }
+        }
+        other.drop_inline();
+        other.tree = nullptr;
+    }
+    SmallSet& operator = (SmallSet other) {
+        swap(other);
+        return *this;
+    }
+
+    ~SmallSet() {
+        drop_inline();
+        delete tree;
+    }
+
+    void swap(SmallSet& other) {
+        SmallSet tmp(std::move(other));
+        other.adopt(std::move(*this));
+        adopt(std::move(tmp));
+    }
+
+    size_t size() const {
+        return tree ? tree->size() : n;
+    }
+    bool empty() const {
+        return (size() == 0);
+    }
+    // True once the set has overflowed into the tree
+    bool spilled() const {
+        return (tree != nullptr);
+    }
+
+    iterator begin() const {
+        return tree ? iterator(tree->begin()) : iterator(vals());
+    }
+    iterator end() const {
+        return tree ? iterator(tree->end()) : iterator(vals() + n);
+    }
+
+    void insert(const ValueType& elem) {
+        if (tree) {
+            tree->insert(elem);
+            return;
+        }
+        size_t pos = inline_lower_bound(elem);
+        if (pos < n && !cmp(elem, vals()[pos])) {
+            return;
+        }
+        if (n == N) {
+            spill();
+            tree->insert(elem);
+            return;
+        }
+        inline_open_slot(pos);
+        new (vals() + pos) ValueType(elem);
+        n++;
+    }
+    void insert(ValueType&& elem) {
+        if (tree) {
+            tree->insert(std::move(elem));
+            return;
+        }
+        size_t pos = inline_lower_bound(elem);
+        if (pos < n && !cmp(elem, vals()[pos])) {
+            return;
+        }
+        if (n == N) {
+            spill();
+            tree->insert(std::move(elem));
+            return;
+        }
+        inline_open_slot(pos);
+        new (vals() + pos) ValueType(std::move(elem));
+        n++;
+    }
+
+    void erase(const ValueType& elem) {
+        if (tree) {
+            tree->erase(elem);
+            return;
+        }
+        size_t pos = inline_lower_bound(elem);
+        if (pos == n || cmp(elem, vals()[pos])) {
+            return;
+        }
+        std::move(vals() + pos + 1, vals() + n, vals() + pos);
+        vals()[n - 1].~ValueType();
+        n--;
+    }
+
+    iterator find(const ValueType& elem) const {
+        if (tree) {
+            return iterator(tree->find(elem));
+        }
+        size_t pos = inline_lower_bound(elem);
+        if (pos < n && !cmp(elem, vals()[pos])) {
+            return iterator(vals() + pos);
+        }
+        return end();
+    }
+    iterator lower_bound(const ValueType& elem) const {
+        if (tree) {
+            return iterator(tree->lower_bound(elem));
+        }
+        return iterator(vals() + inline_lower_bound(elem));
+    }
+    bool contains(const ValueType& elem) const {
+        return find(elem) != end();
+    }
+
+    void clear() {
+        drop_inline();
+        delete tree;
+        tree = nullptr;
+    }
+
+private:
+    ValueType* vals() {
+        return reinterpret_cast<ValueType*>(buf);
+    }
+    const ValueType* vals() const {
+        return reinterpret_cast<const ValueType*>(buf);
+    }
+
+    size_t inline_lower_bound(const ValueType& elem) const {
+        return std::lower_bound(vals(), vals() + n, elem, cmp) - vals();
+    }
+
+    // Makes room at pos for one element; the caller constructs into the gap
+    void inline_open_slot(size_t pos) {
+        if (pos == n) {
+            return;
+        }
+        new (vals() + n) ValueType(std::move(vals()[n - 1]));
+        std::move_backward(vals() + pos, vals() + n - 1, vals() + n);
+        vals()[pos].~ValueType();
+    }
+
+    // Moves the inline array into a fresh tree; the array is already sorted
+    // and unique, so the bulk loader builds it without a single comparison
+    void spill() {
+        tree = new Tree(Tree::from_sorted(
+            std::make_move_iterator(vals()),
+            std::make_move_iterator(vals() + n)));
+        drop_inline();
+    }
+
+    void drop_inline() {
+        for (size_t i = 0; i < n; i++) {
+            vals()[i].~ValueType();
+        }
+        n = 0;
+    }
+
+    void adopt(SmallSet&& other) {
+        drop_inline();
+        delete tree;
+        cmp = other.cmp;
+        tree = other.tree;
+        other.tree = nullptr;
+        for (; n < other.n; n++) {
+            new (vals() + n) ValueType(std::move(other.vals()[n]));
+        }
+        other.drop_inline();
+    }
+
+    alignas(ValueType) unsigned char buf[sizeof(ValueType) * N];
+    size_t n;
+    Tree* tree;
+    Compare cmp;
+};
+
+#endif  // AVL_SMALL_SET_H